@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# Generates the east asian width tables of src/bin/termptydbl_data.c
+# ./unicode_dbl_width.py EastAsianWidth.txt ../src/bin/termptydbl_data.c
+# EastAsianWidth.txt: http://www.unicode.org/Public/UNIDATA/EastAsianWidth.txt
+import re
+import sys
+
+# classes, as in termptydbl.h
+NARROW = 0     # N, Na, H
+WIDE = 1       # W, F
+AMBIGUOUS = 2  # A
+ZERO = 3       # combining marks and format chars
+
+CODEPOINTS = 0x110000
+BLOCK = 256    # codepoints per block of the second level
+PER_BYTE = 4   # 2 bits per codepoint
+
+# unlisted codepoints in these ranges default to W, see the file header
+WIDE_DEFAULTS = [(0x3400, 0x4dbf), (0x4e00, 0x9fff), (0xf900, 0xfaff),
+                 (0x20000, 0x2fffd), (0x30000, 0x3fffd)]
+
+
+def parse(path):
+    widths = [NARROW] * CODEPOINTS
+    version = None
+    for first, last in WIDE_DEFAULTS:
+        for g in range(first, last + 1):
+            widths[g] = WIDE
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            if version is None:
+                m = re.match(r'#\s*EastAsianWidth-([0-9.]+)\.txt', line)
+                if m:
+                    version = m.group(1)
+            data, _, comment = line.partition('#')
+            if not data.strip():
+                continue
+            cps, eaw = [x.strip() for x in data.split(';')]
+            cat = comment.split()[0] if comment.split() else ''
+            if '..' in cps:
+                first, last = [int(x, 16) for x in cps.split('..')]
+            else:
+                first = last = int(cps, 16)
+            if cat in ('Mn', 'Me') or (cat == 'Cf' and first != 0xad):
+                w = ZERO
+            elif eaw in ('W', 'F'):
+                w = WIDE
+            elif eaw == 'A':
+                w = AMBIGUOUS
+            else:
+                w = NARROW
+            for g in range(first, last + 1):
+                widths[g] = w
+    # hangul jamo medial vowels and final consonants combine
+    for g in range(0x1160, 0x1200):
+        widths[g] = ZERO
+    return widths, version or 'unknown'
+
+
+def pack(widths):
+    index, blocks, seen = [], [], {}
+    for start in range(0, CODEPOINTS, BLOCK):
+        block = []
+        for i in range(start, start + BLOCK, PER_BYTE):
+            b = 0
+            for j in range(PER_BYTE):
+                b |= widths[i + j] << (j * 2)
+            block.append(b)
+        block = tuple(block)
+        if block not in seen:
+            seen[block] = len(blocks)
+            blocks.append(block)
+        index.append(seen[block])
+    if len(blocks) > 256:
+        sys.exit('too many distinct blocks for an unsigned char index')
+    return index, blocks
+
+
+def write(path, index, blocks, version):
+    def rows(values, indent):
+        out = []
+        for i in range(0, len(values), 12):
+            out.append(indent + ', '.join('0x%02x' % v
+                                          for v in values[i:i + 12]))
+        return ',\n'.join(out)
+
+    with open(path, 'w') as f:
+        f.write('/* Generated by scripts/unicode_dbl_width.py from '
+                'EastAsianWidth.txt\n')
+        f.write(' * (Unicode %s) - do not edit, regenerate it with\n'
+                % version)
+        f.write(' * "make dblwidth EAW=/path/to/EastAsianWidth.txt" in '
+                'src/bin\n */\n\n')
+        f.write('#include "private.h"\n')
+        f.write('#include <Elementary.h>\n')
+        f.write('#include "termpty.h"\n')
+        f.write('#include "termptydbl.h"\n\n')
+        f.write('const unsigned char _termpty_width_index[%i] =\n{\n'
+                % len(index))
+        f.write(rows(index, '   '))
+        f.write('\n};\n\n')
+        f.write('const unsigned char _termpty_width_blocks[%i][%i] =\n{\n'
+                % (len(blocks), BLOCK // PER_BYTE))
+        f.write(',\n'.join('   {\n' + rows(b, '      ') + '\n   }'
+                           for b in blocks))
+        f.write('\n};\n')
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s EastAsianWidth.txt termptydbl_data.c'
+                 % sys.argv[0])
+    widths, version = parse(sys.argv[1])
+    index, blocks = pack(widths)
+    write(sys.argv[2], index, blocks, version)
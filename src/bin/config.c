@@ -7,7 +7,7 @@
 #include "col.h"
 #include "utils.h"
 
-#define CONF_VER 3
+#define CONF_VER 11
 
 #define LIM(v, min, max) {if (v >= max) v = max; else if (v <= min) v = min;}
 
@@ -128,6 +128,22 @@ config_init(void)
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "mouse_over_focus",
       mouse_over_focus, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "output_latency", output_latency, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "compress_budget", compress_budget, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "compress_chunks", compress_chunks, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "disk_scrollback", disk_scrollback, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "resize_delay", resize_delay, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "scrollback_mem", scrollback_mem, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "max_fps", max_fps, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "max_fps_unfocused", max_fps_unfocused, EET_T_INT);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "colors_use", colors_use, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_ARRAY
@@ -228,6 +244,14 @@ config_sync(const Config *config_src, Config *config)
    config->colors_use = config_src->colors_use;
    memcpy(config->colors, config_src->colors, sizeof(config->colors));
    config->mouse_over_focus = config_src->mouse_over_focus;
+   config->output_latency = config_src->output_latency;
+   config->compress_budget = config_src->compress_budget;
+   config->compress_chunks = config_src->compress_chunks;
+   config->disk_scrollback = config_src->disk_scrollback;
+   config->resize_delay = config_src->resize_delay;
+   config->scrollback_mem = config_src->scrollback_mem;
+   config->max_fps = config_src->max_fps;
+   config->max_fps_unfocused = config_src->max_fps_unfocused;
 }
 
 static void
@@ -291,7 +315,53 @@ config_load(const char *key)
                   config->active_links = EINA_TRUE;
                   config->version = 3;
                   /*pass through*/
-                case CONF_VER: /* 3*/
+                case 3:
+                  /* upgrade to v4 */
+                  config->version = 4;
+                  /*pass through*/
+                case 4:
+                  /* upgrade to v5 */
+                  config->output_latency = 16;
+                  config->version = 5;
+                  /*pass through*/
+                case 5:
+                  /* upgrade to v6 */
+                  config->compress_budget = 4;
+                  config->version = 6;
+                  /*pass through*/
+                case 6:
+                  /* upgrade to v7 */
+                  config->compress_chunks = EINA_FALSE;
+                  config->version = 7;
+                  /*pass through*/
+                case 7:
+                  /* upgrade to v8 */
+                  config->disk_scrollback = EINA_FALSE;
+                  config->version = 8;
+                  /*pass through*/
+                case 8:
+                  /* upgrade to v9 */
+                  config->resize_delay = 50;
+                  config->version = 9;
+                  /*pass through*/
+                case 9:
+                  /* upgrade to v10 */
+                  config->scrollback_mem = 0;
+                  config->version = 10;
+                  /*pass through*/
+                case 10:
+                  /* upgrade to v11 */
+                  config->max_fps = 0;
+                  config->max_fps_unfocused = 10;
+                  config->version = 11;
+                  /*pass through*/
+                case CONF_VER: /* 11 */
+                  LIM(config->output_latency, 1, 100);
+                  LIM(config->compress_budget, 1, 50);
+                  LIM(config->resize_delay, 0, 500);
+                  LIM(config->scrollback_mem, 0, 4096);
+                  LIM(config->max_fps, 0, 240);
+                  LIM(config->max_fps_unfocused, 0, 240);
                   break;
                 default:
                   if (config->version < CONF_VER)
@@ -525,6 +595,14 @@ config_load(const char *key)
              config->erase_is_del = EINA_FALSE;
              config->custom_geometry = EINA_FALSE;
              config->login_shell = EINA_FALSE;
+             config->output_latency = 16;
+             config->compress_budget = 4;
+             config->compress_chunks = EINA_FALSE;
+             config->disk_scrollback = EINA_FALSE;
+             config->resize_delay = 50;
+             config->scrollback_mem = 0;
+             config->max_fps = 0;
+             config->max_fps_unfocused = 10;
              config->cg_width = 80;
              config->cg_height = 24;
              config->colors_use = EINA_FALSE;
@@ -600,6 +678,14 @@ config_fork(Config *config)
    CPY(erase_is_del);
    CPY(custom_geometry);
    CPY(login_shell);
+   CPY(output_latency);
+   CPY(compress_budget);
+   CPY(compress_chunks);
+   CPY(disk_scrollback);
+   CPY(resize_delay);
+   CPY(scrollback_mem);
+   CPY(max_fps);
+   CPY(max_fps_unfocused);
    CPY(cg_width);
    CPY(cg_height);
    CPY(colors_use);
@@ -55,6 +55,14 @@ struct _Config
    Eina_Bool         drag_links;
    Eina_Bool         login_shell;
    Eina_Bool         mouse_over_focus;
+   int               output_latency; /* ms */
+   int               compress_budget; /* ms */
+   Eina_Bool         compress_chunks;
+   Eina_Bool         disk_scrollback;
+   int               resize_delay; /* ms */
+   int               scrollback_mem; /* MB for all terminals, 0 for no limit */
+   int               max_fps; /* redraws a second when focused, 0 for every frame */
+   int               max_fps_unfocused; /* when shown but not focused */
    int               cg_width;
    int               cg_height;
    Eina_Bool         colors_use;
@@ -205,6 +205,77 @@ _cb_op_behavior_sback_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
    config_save(config, NULL);
 }
 
+static void
+_cb_op_behavior_latency_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->output_latency = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_compress_budget_chg(void *data, Evas_Object *obj,
+                                    void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->compress_budget = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_scrollback_mem_chg(void *data, Evas_Object *obj,
+                                   void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->scrollback_mem = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_resize_delay_chg(void *data, Evas_Object *obj,
+                                 void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->resize_delay = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_max_fps_chg(void *data, Evas_Object *obj,
+                            void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->max_fps = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_max_fps_unfocused_chg(void *data, Evas_Object *obj,
+                                      void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->max_fps_unfocused = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
 static void
 _cb_op_behavior_tab_zoom_slider_chg(void *data, Evas_Object *obj,
                                     void *event EINA_UNUSED)
@@ -270,6 +341,26 @@ _cb_op_behavior_login_shell_chg(void *data, Evas_Object *obj, void *event EINA_U
    config_save(config, NULL);
 }
 
+static void
+_cb_op_behavior_compress_chunks_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+   config->compress_chunks = elm_check_state_get(obj);
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_disk_scrollback_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+   config->disk_scrollback = elm_check_state_get(obj);
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
 static void
 _cb_op_behavior_mouse_over_focus_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
 {
@@ -443,6 +534,26 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    evas_object_smart_callback_add(o, "changed",
                                   _cb_op_behavior_login_shell_chg, term);
 
+   o = elm_check_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
+   elm_object_text_set(o, "Compress scrollback in blocks of lines");
+   elm_check_state_set(o, config->compress_chunks);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "changed",
+                                  _cb_op_behavior_compress_chunks_chg, term);
+
+   o = elm_check_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
+   elm_object_text_set(o, "Keep older scrollback on disk");
+   elm_check_state_set(o, config->disk_scrollback);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "changed",
+                                  _cb_op_behavior_disk_scrollback_chg, term);
+
    o = elm_check_add(bx);
    evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
    evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
@@ -561,6 +672,148 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    evas_object_smart_callback_add(o, "delay,changed",
                                   _cb_op_behavior_sback_chg, term);
 
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Output latency target (ms):");
+   elm_object_tooltip_text_set
+      (o, "How long to keep on processing<br>"
+       "heavy output before showing it.<br>"
+       "Higher is faster, lower is smoother");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 1, 100);
+   elm_slider_value_set(o, config->output_latency);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_latency_chg, term);
+
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Scrollback compression budget (ms):");
+   elm_object_tooltip_text_set
+      (o, "How long each pass of the scrollback<br>"
+       "compressor may hold up the terminal");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 1, 50);
+   elm_slider_value_set(o, config->compress_budget);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_compress_budget_chg, term);
+
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Scrollback memory limit (MB):");
+   elm_object_tooltip_text_set
+      (o, "Memory shared by the scrollback of all<br>"
+       "terminals, the oldest lines of the<br>"
+       "biggest go first. 0 for no limit");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 0, 4096);
+   elm_slider_value_set(o, config->scrollback_mem);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_scrollback_mem_chg, term);
+
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Resize delay (ms):");
+   elm_object_tooltip_text_set
+      (o, "How long the size has to stay the same<br>"
+       "before the terminal reflows its lines<br>"
+       "and tells the program it got resized");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 0, 500);
+   elm_slider_value_set(o, config->resize_delay);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_resize_delay_chg, term);
+
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Redraws per second when focused:");
+   elm_object_tooltip_text_set
+      (o, "The most a focused terminal redraws<br>"
+       "in a second. 0 to redraw every frame");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 0, 240);
+   elm_slider_value_set(o, config->max_fps);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_max_fps_chg, term);
+
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Redraws per second when not focused:");
+   elm_object_tooltip_text_set
+      (o, "The same for terminals that are shown<br>"
+       "but not focused. Terminals in hidden<br>"
+       "tabs only redraw once shown again");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 0, 240);
+   elm_slider_value_set(o, config->max_fps_unfocused);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_max_fps_unfocused_chg, term);
+
    o = elm_label_add(bx);
    evas_object_size_hint_weight_set(o, 0.0, 0.0);
    evas_object_size_hint_align_set(o, 0.0, 0.5);
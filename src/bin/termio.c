@@ -6,6 +6,7 @@
 #include "termio.h"
 #include "termiolink.h"
 #include "termpty.h"
+#include "termptysave.h"
 #include "termcmd.h"
 #include "utf8.h"
 #include "col.h"
@@ -21,6 +22,22 @@
 #endif
 
 typedef struct _Termio Termio;
+typedef struct _Colmap_Entry Colmap_Entry;
+
+/* the colours a cell attribute ends up with in the textgrid, cached per
+ * terminal as only a few attributes are in use at any time */
+#define COLMAP_SIZE 256
+
+struct _Colmap_Entry
+{
+   unsigned int key; // the attribute bits the colours depend on
+   unsigned char fg, bg;
+   Eina_Bool fgext : 1;
+   Eina_Bool bgext : 1;
+   Eina_Bool underline : 1;
+   Eina_Bool strike : 1;
+   Eina_Bool used : 1;
+};
 
 struct _Termio
 {
@@ -68,6 +85,7 @@ struct _Termio
    Evas_Object *event;
    Termpty *pty;
    Ecore_Animator *anim;
+   Ecore_Timer *anim_delay; // holds the next redraw back to the max fps
    Ecore_Timer *delayed_size_timer;
    Ecore_Timer *link_do_timer;
    Ecore_Timer *mouse_selection_scroll;
@@ -81,6 +99,7 @@ struct _Termio
    Ecore_Job *sel_reset_job;
    double set_sel_at;
    Elm_Sel_Type sel_type;
+   double last_apply;
    Eina_Bool jump_on_change : 1;
    Eina_Bool jump_on_keypress : 1;
    Eina_Bool have_sel : 1;
@@ -92,9 +111,20 @@ struct _Termio
    Eina_Bool top_left : 1;
    Eina_Bool reset_sel : 1;
    Eina_Bool debugwhite : 1;
+   Eina_Bool hidden_change : 1; // changed while hidden, redraw when shown
+   struct {
+      int scroll, w, h;
+      Eina_Bool inv : 1;
+      Eina_Bool debugwhite : 1;
+   } applied; // what the textgrid was last drawn with
+   struct {
+      Colmap_Entry entry[COLMAP_SIZE];
+      Eina_Bool inv : 1; // the screen reverse the entries are for
+   } colmap;
 };
 
 static Evas_Smart *_smart = NULL;
+static unsigned int _colmap_mask = 0;
 static Evas_Smart_Class _parent_sc = EVAS_SMART_CLASS_INIT_NULL;
 
 static Eina_List *terms = NULL;
@@ -1301,6 +1331,140 @@ _block_activate(Evas_Object *obj, Termblock *blk)
      sd->pty->block.active = eina_list_append(sd->pty->block.active, blk);
 }
 
+static inline unsigned int
+_colmap_key(Termatt att)
+{
+   unsigned int key = 0;
+
+   memcpy(&key, &att, MIN(sizeof(att), sizeof(key)));
+   return key & _colmap_mask;
+}
+
+static void
+_colmap_fill(Colmap_Entry *ce, Termatt att, int inv)
+{
+   int fg, bg, fgext, bgext;
+
+   fg = att.fg;
+   bg = att.bg;
+   fgext = att.fg256;
+   bgext = att.bg256;
+
+   if ((fg == COL_DEF) && (att.inverse ^ inv))
+     fg = COL_INVERSEBG;
+   if (bg == COL_DEF)
+     {
+        if (att.inverse ^ inv)
+          bg = COL_INVERSE;
+        else if (!bgext)
+          bg = COL_INVIS;
+     }
+   if ((att.fgintense) && (!fgext)) fg += 48;
+   if ((att.bgintense) && (!bgext)) bg += 48;
+   if (att.inverse ^ inv)
+     {
+        int t;
+        t = fgext; fgext = bgext; bgext = t;
+        t = fg; fg = bg; bg = t;
+     }
+   if ((att.bold) && (!fgext)) fg += 12;
+   if ((att.faint) && (!fgext)) fg += 24;
+   ce->fg = fg;
+   ce->bg = bg;
+   ce->fgext = fgext;
+   ce->bgext = bgext;
+   ce->underline = att.underline;
+   ce->strike = att.strike;
+}
+
+static inline const Colmap_Entry *
+_colmap_get(Termio *sd, Termatt att, int inv)
+{
+   Colmap_Entry *ce;
+   unsigned int key = _colmap_key(att);
+
+   ce = &(sd->colmap.entry[(key ^ (key >> 8) ^ (key >> 16)) %
+                          COLMAP_SIZE]);
+   if ((ce->used) && (ce->key == key)) return ce;
+   _colmap_fill(ce, att, inv);
+   ce->key = key;
+   ce->used = EINA_TRUE;
+   return ce;
+}
+
+/* changes in a row further apart than this get textgrid updates of their
+ * own, so a far away change doesn't make the glyphs between it and the
+ * others render again */
+#define CHANGE_GAP 8
+
+static inline void
+_smart_change_add(Termio *sd, int x, int y, int *ch1, int *ch2)
+{
+   if ((*ch1 >= 0) && (x - *ch2 > CHANGE_GAP))
+     {
+        evas_object_textgrid_update_add(sd->grid.obj, *ch1, y,
+                                        *ch2 - *ch1 + 1, 1);
+        *ch1 = -1;
+     }
+   if (*ch1 < 0) *ch1 = x;
+   *ch2 = x;
+}
+
+/* rows y1..y2 of the screen moved up by n rows (down if negative) since
+ * the last apply, move the textgrid rows along instead of recomputing
+ * them. rows that came in from outside are dirty in the pty and get
+ * redrawn */
+static void
+_smart_grid_shift_row(Termio *sd, int y, int from)
+{
+   Evas_Textgrid_Cell *tc, *tc_from;
+
+   tc = evas_object_textgrid_cellrow_get(sd->grid.obj, y);
+   tc_from = evas_object_textgrid_cellrow_get(sd->grid.obj, from);
+   if ((!tc) || (!tc_from)) return;
+   memcpy(tc, tc_from, sizeof(Evas_Textgrid_Cell) * sd->grid.w);
+   evas_object_textgrid_cellrow_set(sd->grid.obj, y, tc);
+}
+
+static void
+_smart_grid_shift(Termio *sd, int y1, int y2, int n)
+{
+   int y;
+
+   if ((y1 < 0) || (y2 >= sd->grid.h)) return;
+   if (n > 0)
+     {
+        for (y = y1; y + n <= y2; y++)
+          _smart_grid_shift_row(sd, y, y + n);
+     }
+   else
+     {
+        for (y = y2; y + n >= y1; y--)
+          _smart_grid_shift_row(sd, y, y + n);
+     }
+   evas_object_textgrid_update_add(sd->grid.obj, 0, y1,
+                                   sd->grid.w, y2 - y1 + 1);
+}
+
+/* only the rows the pty marked dirty need looking at, unless what the
+ * textgrid shows depends on more than the screen cells */
+static Eina_Bool
+_smart_apply_full(Termio *sd, int inv)
+{
+   if (sd->pty->dirty.all) return EINA_TRUE;
+   if ((sd->scroll != 0) || (sd->applied.scroll != 0)) return EINA_TRUE;
+   if ((sd->grid.w != sd->applied.w) || (sd->grid.h != sd->applied.h) ||
+       (sd->grid.h != sd->pty->h))
+     return EINA_TRUE;
+   if ((inv != sd->applied.inv) || (sd->debugwhite) ||
+       (sd->applied.debugwhite))
+     return EINA_TRUE;
+   // block positions are refreshed from the cells on every apply
+   if ((termpty_block_any(sd->pty)) || (sd->pty->block.active))
+     return EINA_TRUE;
+   return EINA_FALSE;
+}
+
 static void
 _smart_apply(Evas_Object *obj)
 {
@@ -1309,6 +1473,7 @@ _smart_apply(Evas_Object *obj)
    Eina_List *l, *ln;
    Termblock *blk;
    int x, y, w, ch1 = 0, ch2 = 0, inv = 0;
+   Eina_Bool full;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
    evas_object_geometry_get(obj, &ox, &oy, &ow, &oh);
@@ -1319,12 +1484,22 @@ _smart_apply(Evas_Object *obj)
         blk->active = EINA_FALSE;
      }
    inv = sd->pty->state.reverse;
+   if (inv != sd->colmap.inv)
+     {
+        memset(sd->colmap.entry, 0, sizeof(sd->colmap.entry));
+        sd->colmap.inv = inv;
+     }
+   full = _smart_apply_full(sd, inv);
+   if ((!full) && (sd->pty->dirty.scroll != 0))
+     _smart_grid_shift(sd, sd->pty->dirty.scroll_y1,
+                       sd->pty->dirty.scroll_y2, sd->pty->dirty.scroll);
    termpty_cellcomp_freeze(sd->pty);
    for (y = 0; y < sd->grid.h; y++)
      {
         Termcell *cells;
         Evas_Textgrid_Cell *tc;
 
+        if ((!full) && (!sd->pty->dirty.rows[y])) continue;
         w = 0;
         cells = termpty_cellrow_get(sd->pty, y - sd->scroll, &w);
         tc = evas_object_textgrid_cellrow_get(sd->grid.obj, y);
@@ -1337,10 +1512,7 @@ _smart_apply(Evas_Object *obj)
                   if ((tc[x].codepoint != 0) ||
                       (tc[x].bg != COL_INVIS) ||
                       (tc[x].bg_extended))
-                    {
-                       if (ch1 < 0) ch1 = x;
-                       ch2 = x;
-                    }
+                    _smart_change_add(sd, x, y, &ch1, &ch2);
                   tc[x].codepoint = 0;
                   if (inv) tc[x].bg = COL_INVERSEBG;
                   else tc[x].bg = COL_INVIS;
@@ -1356,8 +1528,7 @@ _smart_apply(Evas_Object *obj)
                   bid = termpty_block_id_get(&(cells[x]), &bx, &by);
                   if (bid >= 0)
                     {
-                       if (ch1 < 0) ch1 = x;
-                       ch2 = x;
+                       _smart_change_add(sd, x, y, &ch1, &ch2);
                        tc[x].codepoint = 0;
                        tc[x].fg_extended = 0;
                        tc[x].bg_extended = 0;
@@ -1387,10 +1558,7 @@ _smart_apply(Evas_Object *obj)
                        if ((tc[x].codepoint != 0) ||
                            (tc[x].bg != COL_INVIS) ||
                            (tc[x].bg_extended))
-                         {
-                            if (ch1 < 0) ch1 = x;
-                            ch2 = x;
-                         }
+                         _smart_change_add(sd, x, y, &ch1, &ch2);
                        tc[x].codepoint = 0;
                        if (inv) tc[x].bg = COL_INVERSEBG;
                        else tc[x].bg = COL_INVIS;
@@ -1406,46 +1574,26 @@ _smart_apply(Evas_Object *obj)
                     }
                   else
                     {
+                       const Colmap_Entry *ce;
                        int fg, bg, fgext, bgext, codepoint;
 
                        // colors
-                       fg = cells[x].att.fg;
-                       bg = cells[x].att.bg;
-                       fgext = cells[x].att.fg256;
-                       bgext = cells[x].att.bg256;
+                       ce = _colmap_get(sd, cells[x].att, inv);
+                       fg = ce->fg;
+                       bg = ce->bg;
+                       fgext = ce->fgext;
+                       bgext = ce->bgext;
                        codepoint = cells[x].codepoint;
 
-                       if ((fg == COL_DEF) && (cells[x].att.inverse ^ inv))
-                         fg = COL_INVERSEBG;
-                       if (bg == COL_DEF)
-                         {
-                            if (cells[x].att.inverse ^ inv)
-                              bg = COL_INVERSE;
-                            else if (!bgext)
-                              bg = COL_INVIS;
-                         }
-                       if ((cells[x].att.fgintense) && (!fgext)) fg += 48;
-                       if ((cells[x].att.bgintense) && (!bgext)) bg += 48;
-                       if (cells[x].att.inverse ^ inv)
-                         {
-                            int t;
-                            t = fgext; fgext = bgext; bgext = t;
-                            t = fg; fg = bg; bg = t;
-                         }
-                       if ((cells[x].att.bold) && (!fgext)) fg += 12;
-                       if ((cells[x].att.faint) && (!fgext)) fg += 24;
                        if ((tc[x].codepoint != codepoint) ||
                            (tc[x].fg != fg) ||
                            (tc[x].bg != bg) ||
                            (tc[x].fg_extended != fgext) ||
                            (tc[x].bg_extended != bgext) ||
-                           (tc[x].underline != cells[x].att.underline) ||
-                           (tc[x].strikethrough != cells[x].att.strike) ||
+                           (tc[x].underline != ce->underline) ||
+                           (tc[x].strikethrough != ce->strike) ||
                            (sd->debugwhite))
-                         {
-                            if (ch1 < 0) ch1 = x;
-                            ch2 = x;
-                         }
+                         _smart_change_add(sd, x, y, &ch1, &ch2);
                        tc[x].fg_extended = fgext;
                        tc[x].bg_extended = bgext;
                        if (sd->debugwhite)
@@ -1472,8 +1620,8 @@ _smart_apply(Evas_Object *obj)
                          }
                        else
                          {
-                            tc[x].underline = cells[x].att.underline;
-                            tc[x].strikethrough = cells[x].att.strike;
+                            tc[x].underline = ce->underline;
+                            tc[x].strikethrough = ce->strike;
                          }
                        tc[x].fg = fg;
                        tc[x].bg = bg;
@@ -1486,18 +1634,22 @@ _smart_apply(Evas_Object *obj)
                          ch2 = x;
                        // cells[x].att.italic // never going 2 support
                        // cells[x].att.blink
-                       // cells[x].att.blink2
                     }
                }
           }
         evas_object_textgrid_cellrow_set(sd->grid.obj, y, tc);
-        /* only bothering to keep 1 change span per row - not worth doing
-         * more really */
+        // the last change span of the row
         if (ch1 >= 0)
           evas_object_textgrid_update_add(sd->grid.obj, ch1, y,
                                           ch2 - ch1 + 1, 1);
      }
    termpty_cellcomp_thaw(sd->pty);
+   termpty_dirty_clear(sd->pty);
+   sd->applied.scroll = sd->scroll;
+   sd->applied.w = sd->grid.w;
+   sd->applied.h = sd->grid.h;
+   sd->applied.inv = inv;
+   sd->applied.debugwhite = sd->debugwhite;
    
    EINA_LIST_FOREACH_SAFE(sd->pty->block.active, l, ln, blk)
      {
@@ -1677,15 +1829,87 @@ _smart_cb_change(void *data)
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
    sd->anim = NULL;
+   sd->last_apply = ecore_loop_time_get();
    _smart_apply(obj);
    evas_object_smart_callback_call(obj, "changed", NULL);
    return EINA_FALSE;
 }
 
+/* in a hidden tab or a minimized window, nothing we draw is seen */
+static Eina_Bool
+_smart_visible(Evas_Object *obj, Termio *sd)
+{
+   Evas_Object *o;
+
+   if ((sd->win) && (elm_win_iconified_get(sd->win))) return EINA_FALSE;
+   for (o = obj; o; o = evas_object_smart_parent_get(o))
+     {
+        if (!evas_object_visible_get(o)) return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+static void
+_smart_cb_render_pre(void *data, Evas *e, void *info EINA_UNUSED)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   if (!_smart_visible(obj, sd)) return;
+   evas_event_callback_del_full(e, EVAS_CALLBACK_RENDER_PRE,
+                                _smart_cb_render_pre, obj);
+   sd->hidden_change = EINA_FALSE;
+   // catch up in the very frame that shows us again
+   if (sd->anim) ecore_animator_del(sd->anim);
+   sd->anim = NULL;
+   _smart_cb_change(obj);
+}
+
+static Eina_Bool
+_smart_cb_anim_delay(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   sd->anim_delay = NULL;
+   if (!sd->anim) sd->anim = ecore_animator_add(_smart_cb_change, obj);
+   return EINA_FALSE;
+}
+
+/* the focused terminal redraws on every frame unless config caps it,
+ * shown but unfocused ones at their own cap and hidden ones not at all,
+ * until the canvas renders them again */
 static void
 _smart_update_queue(Evas_Object *obj, Termio *sd)
 {
-   if (sd->anim) return;
+   double wait;
+   int fps = 0;
+
+   if ((sd->anim) || (sd->anim_delay) || (sd->hidden_change)) return;
+   if (!_smart_visible(obj, sd))
+     {
+        sd->hidden_change = EINA_TRUE;
+        evas_event_callback_add(evas_object_evas_get(obj),
+                                EVAS_CALLBACK_RENDER_PRE,
+                                _smart_cb_render_pre, obj);
+        return;
+     }
+   if (sd->config)
+     {
+        if (evas_object_focus_get(obj)) fps = sd->config->max_fps;
+        else fps = sd->config->max_fps_unfocused;
+     }
+   if (fps > 0)
+     {
+        wait = sd->last_apply + (1.0 / fps) - ecore_loop_time_get();
+        if (wait > 0.0)
+          {
+             sd->anim_delay = ecore_timer_add(wait, _smart_cb_anim_delay, obj);
+             return;
+          }
+     }
    sd->anim = ecore_animator_add(_smart_cb_change, obj);
 }
 
@@ -2018,8 +2242,8 @@ _handle_shift(Evas_Event_Key_Down *ev, int by, Evas_Object *term, Termio *sd)
         if (!(sd->pty->altbuf))
           {
              sd->scroll += by;
-             if (sd->scroll > sd->pty->backscroll_num)
-               sd->scroll = sd->pty->backscroll_num;
+             if (sd->scroll > termpty_backscroll_num_get(sd->pty))
+               sd->scroll = termpty_backscroll_num_get(sd->pty);
              _smart_update_queue(term, sd);
           }
      }
@@ -2309,6 +2533,13 @@ _smart_cb_focus_in(void *data, Evas *e EINA_UNUSED,
      edje_object_signal_emit(sd->cursor.obj, "focus,in,noblink", "terminology");
    else
      edje_object_signal_emit(sd->cursor.obj, "focus,in", "terminology");
+   // the unfocused rate may be holding a redraw back
+   if (sd->anim_delay)
+     {
+        ecore_timer_del(sd->anim_delay);
+        sd->anim_delay = NULL;
+        _smart_update_queue(data, sd);
+     }
    if (!sd->win) return;
    elm_win_keyboard_mode_set(sd->win, ELM_WIN_KEYBOARD_TERMINAL);
    if (sd->imf)
@@ -3253,8 +3484,8 @@ _mouse_selection_scroll(void *data)
    if (cy < 0)
      {
         sd->scroll -= cy;
-        if (sd->scroll > sd->pty->backscroll_num)
-          sd->scroll = sd->pty->backscroll_num;
+        if (sd->scroll > termpty_backscroll_num_get(sd->pty))
+          sd->scroll = termpty_backscroll_num_get(sd->pty);
         sd->pty->selection.end.y = -sd->scroll;
         _smart_update_queue(data, sd);
      }
@@ -3442,8 +3673,8 @@ _smart_cb_mouse_wheel(void *data, Evas *e EINA_UNUSED, Evas_Object *obj EINA_UNU
         else
           {
              sd->scroll -= (ev->z * 4);
-             if (sd->scroll > sd->pty->backscroll_num)
-               sd->scroll = sd->pty->backscroll_num;
+             if (sd->scroll > termpty_backscroll_num_get(sd->pty))
+               sd->scroll = termpty_backscroll_num_get(sd->pty);
              else if (sd->scroll < 0) sd->scroll = 0;
              _smart_update_queue(data, sd);
           }
@@ -3841,6 +4072,11 @@ _smart_del(Evas_Object *obj)
    if (sd->sel.bottom) evas_object_del(sd->sel.bottom);
    if (sd->sel.theme) evas_object_del(sd->sel.theme);
    if (sd->anim) ecore_animator_del(sd->anim);
+   if (sd->anim_delay) ecore_timer_del(sd->anim_delay);
+   if (sd->hidden_change)
+     evas_event_callback_del_full(evas_object_evas_get(obj),
+                                  EVAS_CALLBACK_RENDER_PRE,
+                                  _smart_cb_render_pre, obj);
    if (sd->delayed_size_timer) ecore_timer_del(sd->delayed_size_timer);
    if (sd->link_do_timer) ecore_timer_del(sd->link_do_timer);
    if (sd->mouse_move_job) ecore_job_del(sd->mouse_move_job);
@@ -3871,6 +4107,8 @@ _smart_del(Evas_Object *obj)
    sd->sel.bottom = NULL;
    sd->sel.theme = NULL;
    sd->anim = NULL;
+   sd->anim_delay = NULL;
+   sd->hidden_change = EINA_FALSE;
    sd->delayed_size_timer = NULL;
    sd->font.name = NULL;
    sd->pty = NULL;
@@ -3887,14 +4125,17 @@ _smart_resize(Evas_Object *obj, Evas_Coord w, Evas_Coord h)
 {
    Termio *sd = evas_object_smart_data_get(obj);
    Evas_Coord ow, oh;
+   double delay = 0.0;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
    evas_object_geometry_get(obj, NULL, NULL, &ow, &oh);
    if ((ow == w) && (oh == h)) return;
    evas_object_smart_changed(obj);
-   if (!sd->delayed_size_timer) sd->delayed_size_timer = 
-     ecore_timer_add(0.0, _smart_cb_delayed_size, obj);
-   else ecore_timer_delay(sd->delayed_size_timer, 0.0);
+   // while the size keeps changing the grid is shown as it is, clipped or
+   // padded, and lines are reflowed and the pty resized once it settles
+   if (sd->config) delay = (double)sd->config->resize_delay / 1000.0;
+   if (sd->delayed_size_timer) ecore_timer_del(sd->delayed_size_timer);
+   sd->delayed_size_timer = ecore_timer_add(delay, _smart_cb_delayed_size, obj);
    evas_object_resize(sd->event, ow, oh);
 }
 
@@ -3902,11 +4143,16 @@ static void
 _smart_calculate(Evas_Object *obj)
 {
    Termio *sd = evas_object_smart_data_get(obj);
+   Evas_Object *clip;
    Evas_Coord ox, oy, ow, oh;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
 
    evas_object_geometry_get(obj, &ox, &oy, &ow, &oh);
+   // a grid waiting on a delayed resize can be bigger than the object
+   clip = evas_object_smart_clipped_clipper_get(obj);
+   evas_object_move(clip, ox, oy);
+   evas_object_resize(clip, ow, oh);
    evas_object_move(sd->grid.obj, ox, oy);
    evas_object_resize(sd->grid.obj,
                       sd->grid.w * sd->font.chw,
@@ -3931,6 +4177,15 @@ static void
 _smart_init(void)
 {
    static Evas_Smart_Class sc;
+   Termatt mask;
+
+   // the attribute bits _colmap_fill() looks at
+   memset(&mask, 0, sizeof(mask));
+   mask.fg = mask.bg = 0xff;
+   mask.bold = mask.faint = mask.underline = mask.inverse = 1;
+   mask.strike = mask.fg256 = mask.bg256 = 1;
+   mask.fgintense = mask.bgintense = 1;
+   memcpy(&_colmap_mask, &mask, MIN(sizeof(mask), sizeof(_colmap_mask)));
 
    evas_object_smart_clipped_smart_set(&_parent_sc);
    sc           = _parent_sc;
@@ -3967,9 +4222,9 @@ termio_scroll(Evas_Object *obj, int direction, int start_y, int end_y)
        (sd->scroll > 0))
      {
         // adjust scroll position for added scrollback
-        sd->scroll++;
-        if (sd->scroll > sd->pty->backscroll_num)
-          sd->scroll = sd->pty->backscroll_num;
+        sd->scroll += abs(direction);
+        if (sd->scroll > termpty_backscroll_num_get(sd->pty))
+          sd->scroll = termpty_backscroll_num_get(sd->pty);
      }
    ty = sd->pty;
    if (ty->selection.is_active)
@@ -4051,6 +4306,25 @@ termio_content_change(Evas_Object *obj, Evas_Coord x, Evas_Coord y,
      }
 }
 
+void
+termio_backscroll_drop(Evas_Object *obj)
+{
+   Termpty *ty;
+   Termio *sd = evas_object_smart_data_get(obj);
+   int top;
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   // the oldest rows of the history are gone or reflowed, the view and the
+   // selection must not point past them any more
+   ty = sd->pty;
+   top = termpty_backscroll_num_get(ty);
+   if (sd->scroll > top) sd->scroll = top;
+   if ((ty->selection.is_active) &&
+       (MIN(ty->selection.start.y, ty->selection.end.y) < -top))
+     _sel_set(obj, EINA_FALSE);
+   _smart_update_queue(obj, sd);
+}
+
 static void
 _smart_pty_title(void *data)
 {
@@ -4498,6 +4772,11 @@ termio_add(Evas_Object *parent, Config *config, const char *cmd, Eina_Bool login
         evas_object_del(obj);
         return NULL;
      }
+   termpty_latency_set(sd->pty, config->output_latency);
+   termpty_save_budget_set(config->compress_budget);
+   termpty_save_mem_budget_set(config->scrollback_mem);
+   termpty_save_chunks_set(config->compress_chunks);
+   termpty_save_spill_set(sd->pty, config->disk_scrollback);
    sd->pty->obj = obj;
    sd->pty->cb.change.func = _smart_pty_change;
    sd->pty->cb.change.data = obj;
@@ -4730,6 +5009,11 @@ termio_config_update(Evas_Object *obj)
    sd->jump_on_keypress = sd->config->jump_on_keypress;
 
    termpty_backscroll_set(sd->pty, sd->config->scrollback);
+   termpty_latency_set(sd->pty, sd->config->output_latency);
+   termpty_save_budget_set(sd->config->compress_budget);
+   termpty_save_mem_budget_set(sd->config->scrollback_mem);
+   termpty_save_chunks_set(sd->config->compress_chunks);
+   termpty_save_spill_set(sd->pty, sd->config->disk_scrollback);
    sd->scroll = 0;
 
    if (evas_object_focus_get(obj))
@@ -4792,6 +5076,8 @@ termio_mouseover_suspend_pushpop(Evas_Object *obj, int dir)
      {
         if (sd->anim) ecore_animator_del(sd->anim);
         sd->anim = NULL;
+        if (sd->anim_delay) ecore_timer_del(sd->anim_delay);
+        sd->anim_delay = NULL;
         _smart_apply(obj);
      }
    else
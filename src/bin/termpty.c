@@ -32,6 +32,8 @@ int _termpty_log_dom = -1;
 #define INF(...)      EINA_LOG_DOM_INFO(_termpty_log_dom, __VA_ARGS__)
 #define DBG(...)      EINA_LOG_DOM_DBG(_termpty_log_dom, __VA_ARGS__)
 
+static void _reflow_free(Termpty *ty);
+
 void
 termpty_init(void)
 {
@@ -50,93 +52,27 @@ termpty_shutdown(void)
    _termpty_log_dom = -1;
 }
 
-static void
-_handle_buf(Termpty *ty, const Eina_Unicode *codepoints, int len)
+/* decoded codepoints are handed to the parser straight away - it keeps
+ * its own state between reads, so nothing is left over in here */
+static Eina_Bool
+_input_reserve(Termpty *ty, int n)
 {
-   Eina_Unicode *c, *ce, *b;
-   int n, bytes;
-
-   c = (Eina_Unicode *)codepoints;
-   ce = &(c[len]);
-
-   if (ty->buf)
-     {
-        bytes = (ty->buflen + len + 1) * sizeof(int);
-        b = realloc(ty->buf, bytes);
-        if (!b)
-          {
-             ERR("memerr");
-             return;
-          }
-        INF("realloc add %i + %i", (int)(ty->buflen * sizeof(int)), (int)(len * sizeof(int)));
-        bytes = len * sizeof(Eina_Unicode);
-        memcpy(&(b[ty->buflen]), codepoints, bytes);
-        ty->buf = b;
-        ty->buflen += len;
-        ty->buf[ty->buflen] = 0;
-        c = ty->buf;
-        ce = c + ty->buflen;
-        while (c < ce)
-          {
-             n = _termpty_handle_seq(ty, c, ce);
-             if (n == 0)
-               {
-                  Eina_Unicode *tmp = ty->buf;
-                  ty->buf = NULL;
-                  ty->buflen = 0;
-                  bytes = ((char *)ce - (char *)c) + sizeof(Eina_Unicode);
-                  INF("malloc til %i", (int)(bytes - sizeof(Eina_Unicode)));
-                  ty->buf = malloc(bytes);
-                  if (!ty->buf)
-                    {
-                       ERR("memerr");
-                       return;
-                    }
-                  bytes = (char *)ce - (char *)c;
-                  memcpy(ty->buf, c, bytes);
-                  ty->buflen = bytes / sizeof(Eina_Unicode);
-                  ty->buf[ty->buflen] = 0;
-                  free(tmp);
-                  break;
-               }
-             c += n;
-          }
-        if (c == ce)
-          {
-             if (ty->buf)
-               {
-                  free(ty->buf);
-                  ty->buf = NULL;
-               }
-             ty->buflen = 0;
-          }
-     }
-   else
+   Eina_Unicode *b;
+   int size;
+
+   if (ty->input.size >= n) return EINA_TRUE;
+   size = ty->input.size ? ty->input.size : 4096;
+   while (size < n) size *= 2;
+   INF("input buffer %i -> %i", ty->input.size, size);
+   b = realloc(ty->input.buf, size * sizeof(Eina_Unicode));
+   if (!b)
      {
-        while (c < ce)
-          {
-             n = _termpty_handle_seq(ty, c, ce);
-             if (n == 0)
-               {
-                  bytes = ((char *)ce - (char *)c) + sizeof(Eina_Unicode);
-                  ty->buf = malloc(bytes);
-                  INF("malloc %i", (int)(bytes - sizeof(Eina_Unicode)));
-                  if (!ty->buf)
-                    {
-                       ERR("memerr");
-                    }
-                  else
-                    {
-                       bytes = (char *)ce - (char *)c;
-                       memcpy(ty->buf, c, bytes);
-                       ty->buflen = bytes / sizeof(Eina_Unicode);
-                       ty->buf[ty->buflen] = 0;
-                    }
-                  break;
-               }
-             c += n;
-          }
+        ERR("memerr");
+        return EINA_FALSE;
      }
+   ty->input.buf = b;
+   ty->input.size = size;
+   return EINA_TRUE;
 }
 
 static void
@@ -177,34 +113,131 @@ _cb_exe_exit(void *data, int type EINA_UNUSED, void *event)
    return ECORE_CALLBACK_PASS_ON;
 }
 
-static Eina_Bool
-_cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+/* ascii can skip decoding and the sequence parser when nothing is pending:
+ * no partial utf8 sequence, no partial escape and no inline media block
+ * waiting for its placeholder chars */
+static inline Eina_Bool
+_ascii_direct(const Termpty *ty)
 {
-   Termpty *ty = data;
-   char buf[4097];
-   Eina_Unicode codepoint[4097];
-   int len, i, j, k, reads;
+   return ((ty->parser.state == TERMPTY_PARSE_GROUND) &&
+           (!ty->decoder.left) &&
+           (!((ty->block.expecting) && (ty->block.on))));
+}
 
-   // read up to 64 * 4096 bytes
-   for (reads = 0; reads < 64; reads++)
+/* printable runs shorter than this are not worth leaving the decoder for */
+#define ASCII_RUN_MIN 16
+
+/* bytes from p up to the next long printable run, which can then go to
+ * the screen directly if the parser is back on the ground by then */
+static int
+_span_len(const char *p, const char *pe)
+{
+   const char *s = p + 1;
+   int run;
+
+   while (s < pe)
      {
-        char *rbuf = buf;
-        len = sizeof(buf) - 1;
+        run = utf8_ascii_printable_len(s, pe - s);
+        if (run >= ASCII_RUN_MIN) break;
+        // skip the run and the byte that ended it
+        s += run + 1;
+     }
+   if (s > pe) s = pe;
+   return s - p;
+}
 
-        for (i = 0; i < (int)sizeof(ty->oldbuf) && ty->oldbuf[i] & 0x80; i++)
+/* plain lines output at the bottom of the scroll region scroll once per
+ * newline. count the newlines coming up and scroll them all at once, the
+ * cursor going as many rows up to come back down as they are parsed. the
+ * look ahead stops at anything but text, CR, LF, BS and HT, so nothing in
+ * between can move the cursor up or change the region. returns where it
+ * stopped looking */
+static const char *
+_scroll_ahead(Termpty *ty, const char *p, const char *pe)
+{
+   int top = 0, bottom = ty->h, max, n = 0;
+   unsigned char c;
+
+   if (ty->state.scroll_y2 != 0)
+     {
+        top = ty->state.scroll_y1;
+        bottom = ty->state.scroll_y2;
+     }
+   if (ty->state.cy != bottom - 1) return p;
+   // the row the cursor is on can't go before it is done with
+   max = bottom - 1 - top;
+   if ((max < 2) || (bottom > ty->h)) return p;
+   for (; p < pe; p++)
+     {
+        c = *p;
+        if ((c == '\n') || (c == '\v') || (c == '\f'))
           {
-             *rbuf = ty->oldbuf[i];
-             rbuf++;
-             len--;
+             if (++n == max)
+               {
+                  p++;
+                  break;
+               }
           }
-        len = read(ty->fd, rbuf, len);
-        if (len <= 0) break;
+        else if (c < 0x20)
+          {
+             if ((c != '\r') && (c != '\b') && (c != '\t')) break;
+          }
+        else if (c == 0x7f) break;
+        // utf8 encoded C1 controls, CSI among them
+        else if ((c == 0xc2) &&
+                 ((p + 1 >= pe) || ((unsigned char)p[1] < 0xa0))) break;
+     }
+   if (n > 1)
+     {
+        _termpty_text_scroll_n(ty, n, EINA_TRUE);
+        ty->state.cy -= n;
+     }
+   return p;
+}
 
+static void
+_handle_input(Termpty *ty, const char *buf, int len)
+{
+   const char *p = buf, *pe = buf + len, *ahead = buf;
+   int n, j;
 
-        for (i = 0; i < (int)sizeof(ty->oldbuf); i++)
-          ty->oldbuf[i] = 0;
+   while (p < pe)
+     {
+        if (_ascii_direct(ty))
+          {
+             if (p >= ahead) ahead = _scroll_ahead(ty, p, pe);
+             n = utf8_ascii_printable_len(p, pe - p);
+             if (n > 0)
+               {
+                  _termpty_handle_ascii(ty, p, n);
+                  p += n;
+                  continue;
+               }
+          }
+        n = _span_len(p, pe);
+        // one more for a replacement char left over from the last read
+        if (!_input_reserve(ty, n + 1)) return;
+        j = utf8_decode(&(ty->decoder), p, n, ty->input.buf);
+        if (j > 0) _termpty_parse(ty, ty->input.buf, ty->input.buf + j);
+        p += n;
+     }
+}
 
-        len += rbuf - buf;
+/* under a flood the screen can't show every intermediate state anyway, so
+ * parse for as long as the latency target allows and only then let termio
+ * render what we ended up with. a single update is queued per batch */
+static Eina_Bool
+_cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+{
+   Termpty *ty = data;
+   char buf[4096];
+   double t0 = ecore_time_get();
+   int len;
+
+   for (;;)
+     {
+        len = read(ty->fd, buf, sizeof(buf));
+        if (len <= 0) break;
 
         /*
         printf(" I: ");
@@ -218,47 +251,8 @@ _cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
           }
         printf("\n");
         */
-        buf[len] = 0;
-        // convert UTF8 to codepoint integers
-        j = 0;
-        for (i = 0; i < len;)
-          {
-             int g = 0, prev_i = i;
-
-             if (buf[i])
-               {
-#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
-                  g = eina_unicode_utf8_next_get(buf, &i);
-                  if ((0xdc80 <= g) && (g <= 0xdcff) &&
-                      (len - prev_i) <= (int)sizeof(ty->oldbuf))
-#else
-                  i = evas_string_char_next_get(buf, i, &g);
-                  if (i < 0 &&
-                      (len - prev_i) <= (int)sizeof(ty->oldbuf))
-#endif
-                    {
-                       for (k = 0;
-                            (k < (int)sizeof(ty->oldbuf)) && 
-                            (k < (len - prev_i));
-                            k++)
-                         {
-                            ty->oldbuf[k] = buf[prev_i+k];
-                         }
-                       DBG("failure at %d/%d/%d", prev_i, i, len);
-                       break;
-                    }
-               }
-             else
-               {
-                  g = 0;
-                  i++;
-               }
-             codepoint[j] = g;
-             j++;
-          }
-        codepoint[j] = 0;
-//        DBG("---------------- handle buf %i", j);
-        _handle_buf(ty, codepoint, j);
+        _handle_input(ty, buf, len);
+        if ((ecore_time_get() - t0) >= ty->latency) break;
      }
    if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
    return EINA_TRUE;
@@ -289,6 +283,7 @@ termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
    ty->w = w;
    ty->h = h;
    ty->backmax = backscroll;
+   termpty_latency_set(ty, 16);
 
    _termpty_reset_state(ty);
    ty->save = ty->state;
@@ -308,6 +303,8 @@ termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
      }
 
    ty->circular_offset = 0;
+   ty->dirty.rows = calloc(1, ty->h);
+   termpty_dirty_all(ty);
 
    ty->fd = posix_openpt(O_RDWR | O_NOCTTY);
    if (ty->fd < 0)
@@ -472,6 +469,7 @@ termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
 err:
    if (ty->screen) free(ty->screen);
    if (ty->screen2) free(ty->screen2);
+   if (ty->dirty.rows) free(ty->dirty.rows);
    if (ty->fd >= 0) close(ty->fd);
    if (ty->slavefd >= 0) close(ty->slavefd);
    free(ty);
@@ -544,9 +542,12 @@ termpty_free(Termpty *ty)
         free(ty->back);
         ty->back = NULL;
      }
+   _reflow_free(ty);
    if (ty->screen) free(ty->screen);
    if (ty->screen2) free(ty->screen2);
-   if (ty->buf) free(ty->buf);
+   if (ty->dirty.rows) free(ty->dirty.rows);
+   if (ty->input.buf) free(ty->input.buf);
+   if (ty->parser.str.buf) free(ty->parser.str.buf);
    memset(ty, 0, sizeof(Termpty));
    free(ty);
 }
@@ -566,7 +567,7 @@ termpty_cellcomp_thaw(Termpty *ty EINA_UNUSED)
 Termcell *
 termpty_cellrow_get(Termpty *ty, int y, int *wret)
 {
-   Termsave *ts, **tssrc;
+   int slot;
 
    if (y >= 0)
      {
@@ -575,13 +576,108 @@ termpty_cellrow_get(Termpty *ty, int y, int *wret)
 	/* fprintf(stderr, "getting: %i (%i, %i)\n", y, ty->circular_offset, ty->h); */
         return &(TERMPTY_SCREEN(ty, 0, y));
      }
+   if (y < -ty->backscroll_num)
+     {
+        int k = -y - ty->backscroll_num - 1;
+
+        // older than back[] are the lines a resize left to reflow later,
+        // as they were saved, and then the rows that went to disk
+        if (k < ty->reflow.num)
+          return termpty_save_cells_get(ty->reflow.rows[ty->reflow.num - 1 -
+                                                        k], wret);
+        if (ty->spill)
+          return termpty_save_spill_get(ty, k - ty->reflow.num, wret);
+     }
    if ((y < -ty->backmax) || !ty->back) return NULL;
-   tssrc = &(ty->back[(ty->backmax + ty->backpos + y) % ty->backmax]);
-   ts = termpty_save_extract(*tssrc);
-   if (!ts) return NULL;
-   *tssrc = ts;
-   *wret = ts->w;
-   return ts->cell;
+   slot = (ty->backmax + ty->backpos + y) % ty->backmax;
+   // reading leaves compressed rows compressed
+   return termpty_save_cells_get(ty->back[slot], wret);
+}
+
+/* what changed on screen since termio last drew it, so it only redraws
+ * those rows. a scroll moves the marks along with the rows and termio
+ * moves its own rows by dirty.scroll instead of redrawing them. without a
+ * row map everything is always dirty */
+void
+termpty_dirty_rows(Termpty *ty, int y1, int y2)
+{
+   if ((ty->dirty.all) || (!ty->dirty.rows)) return;
+   if (y1 < 0) y1 = 0;
+   if (y1 > y2) return;
+   if (y2 - y1 + 1 >= ty->h)
+     {
+        memset(ty->dirty.rows, 1, ty->h);
+        return;
+     }
+   // like in TERMPTY_SCREEN(), rows past the bottom are the top ones
+   y1 %= ty->h;
+   y2 %= ty->h;
+   if (y2 < y1)
+     {
+        memset(ty->dirty.rows, 1, y2 + 1);
+        y2 = ty->h - 1;
+     }
+   memset(ty->dirty.rows + y1, 1, y2 - y1 + 1);
+}
+
+/* rows y1..y2 moved up by n (down if negative). only one region can
+ * have a pending move, a scroll elsewhere just marks its rows */
+void
+termpty_dirty_scroll(Termpty *ty, int y1, int y2, int n)
+{
+   int rows = y2 - y1 + 1;
+   unsigned char *r;
+
+   if ((ty->dirty.all) || (!ty->dirty.rows) || (n == 0)) return;
+   if ((y1 < 0) || (y2 >= ty->h) || (rows < 1))
+     {
+        termpty_dirty_rows(ty, y1, y2);
+        return;
+     }
+   if (ty->dirty.scroll == 0)
+     {
+        ty->dirty.scroll_y1 = y1;
+        ty->dirty.scroll_y2 = y2;
+     }
+   else if ((ty->dirty.scroll_y1 != y1) || (ty->dirty.scroll_y2 != y2))
+     {
+        termpty_dirty_rows(ty, y1, y2);
+        return;
+     }
+   if ((abs(n) >= rows) || (abs(ty->dirty.scroll + n) >= rows))
+     {
+        termpty_dirty_rows(ty, y1, y2);
+        ty->dirty.scroll = 0;
+        return;
+     }
+   r = ty->dirty.rows + y1;
+   if (n > 0)
+     {
+        memmove(r, r + n, rows - n);
+        memset(r + rows - n, 1, n);
+     }
+   else
+     {
+        memmove(r - n, r, rows + n);
+        memset(r, 1, -n);
+     }
+   ty->dirty.scroll += n;
+}
+
+void
+termpty_dirty_all(Termpty *ty)
+{
+   ty->dirty.all = EINA_TRUE;
+   ty->dirty.scroll = 0;
+}
+
+void
+termpty_dirty_clear(Termpty *ty)
+{
+   ty->dirty.scroll = 0;
+   if (!ty->dirty.rows) return;
+   memset(ty->dirty.rows, 0, ty->h);
+   ty->dirty.all = EINA_FALSE;
 }
    
 void
@@ -612,7 +708,6 @@ static int
 termpty_line_find_top(Termpty *ty, int y_end)
 {
    int y_start = y_end;
-   Termsave *ts;
 
    while (y_start > 0)
      {
@@ -623,10 +718,8 @@ termpty_line_find_top(Termpty *ty, int y_end)
      }
    while (-y_start < ty->backscroll_num)
      {
-        ts = termpty_save_extract(ty->back[(y_start + ty->backpos - 1 +
-                                            ty->backmax) % ty->backmax]);
-        ty->back[(y_start + ty->backpos - 1 + ty->backmax) % ty->backmax] = ts;
-        if (ts->cell[ts->w - 1].att.autowrapped)
+        if (termpty_save_wrapped(ty->back[(y_start + ty->backpos - 1 +
+                                           ty->backmax) % ty->backmax]))
           y_start--;
         else
           return y_start;
@@ -634,14 +727,121 @@ termpty_line_find_top(Termpty *ty, int y_end)
    return y_start;
 }
 
+/* rows of history reflowed at once on a resize, above the screen */
+#define REFLOW_MARGIN 1024
+
+static void
+_reflow_free(Termpty *ty)
+{
+   int i;
+
+   for (i = 0; i < ty->reflow.num; i++)
+     termpty_save_free(ty->reflow.rows[i]);
+   free(ty->reflow.rows);
+   ty->reflow.rows = NULL;
+   ty->reflow.num = 0;
+}
+
+// saved rows y_start..y_end leave back[] to be reflowed later
+static void
+_reflow_queue(Termpty *ty, int y_start, int y_end)
+{
+   Termsave **rows;
+   int y, slot;
+
+   rows = realloc(ty->reflow.rows, (ty->reflow.num + y_end - y_start + 1) *
+                  sizeof(Termsave *));
+   if (!rows)
+     {
+        // they are then freed along with the old back[]
+        ERR("memerr");
+        return;
+     }
+   ty->reflow.rows = rows;
+   for (y = y_start; y <= y_end; y++)
+     {
+        slot = (y + ty->backpos + ty->backmax) % ty->backmax;
+        if (!ty->back[slot]) continue;
+        rows[ty->reflow.num++] = ty->back[slot];
+        ty->back[slot] = NULL;
+     }
+}
+
+/* a reflow can leave more rows than the new back[] holds. with the disk
+ * tier on they go out there, oldest first, instead of being lost */
+static void
+_resize_spill_rows(Termpty *ty, int y_start, int y_end)
+{
+   Termsave *ts;
+   int y, len;
+
+   for (y = y_start; y <= y_end; y++)
+     {
+        if (y < 0)
+          {
+             termpty_save_drop(ty, (y + ty->backpos + ty->backmax) %
+                               ty->backmax);
+             continue;
+          }
+        len = termpty_line_length(&TERMPTY_SCREEN(ty, 0, y), ty->w);
+        ts = termpty_save_new(len);
+        if (!ts) continue;
+        memcpy(ts->cell, &TERMPTY_SCREEN(ty, 0, y), len * sizeof(Termcell));
+        termpty_save_spill(ty, ts);
+        termpty_save_free(ts);
+     }
+}
+
+// the first cells of a line cut short by a reflow, as rows of the new width
+static Eina_List *
+_line_head_rows(Termpty *ty, int y_start, int cells, int w2)
+{
+   Eina_List *rows = NULL;
+   Termsave *ts;
+   Termcell *line = NULL;
+   int i, x, y, w = 0, y_line = y_start - 1;
+
+   for (i = 0; i < cells; i += w2)
+     {
+        ts = termpty_save_new(w2);
+        if (!ts) break;
+        for (x = 0; x < w2; x++)
+          {
+             y = y_start + ((i + x) / ty->w);
+             if (y != y_line)
+               {
+                  y_line = y;
+                  if (y >= 0)
+                    {
+                       line = &TERMPTY_SCREEN(ty, 0, y);
+                       w = ty->w;
+                    }
+                  else
+                    line = termpty_save_cells_get(ty->back[(y + ty->backpos +
+                                                            ty->backmax) %
+                                                           ty->backmax], &w);
+               }
+             if ((line) && (((i + x) % ty->w) < w))
+               ts->cell[x] = line[(i + x) % ty->w];
+             else
+               memset(&(ts->cell[x]), 0, sizeof(Termcell));
+             ts->cell[x].att.autowrapped = 0;
+          }
+        // the line goes on in the rows that did fit
+        ts->cell[w2 - 1].att.autowrapped = 1;
+        rows = eina_list_append(rows, ts);
+     }
+   return rows;
+}
+
 static int
 termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
                     Termcell *screen2, Termsave **back2,
-                    int w2, int y2_end)
+                    int w2, int y2_end, Eina_List **head)
 {
    int x, x2, y, y2, y2_start;
-   int len, len_last, len_remaining, copy_width, ts2_width;
-   Termsave *ts, *ts2;
+   int len, len_last, len_remaining, copy_width, ts2_width, w;
+   Termsave *ts2;
    Termcell *line, *line2 = NULL;
 
    if (y_end >= 0)
@@ -650,10 +850,8 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
      }
    else
      {
-        ts = termpty_save_extract(ty->back[(y_end + ty->backpos +
-                                            ty->backmax) % ty->backmax]);
-        ty->back[(y_end + ty->backpos + ty->backmax) % ty->backmax] = ts;
-        len_last = ts->w;
+        len_last = termpty_save_width(ty->back[(y_end + ty->backpos +
+                                                ty->backmax) % ty->backmax]);
      }
    len_remaining = len_last + (y_end - y_start) * ty->w;
    y2_start = y2_end;
@@ -669,6 +867,9 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
      }
    if (-y2_start > ty->backmax)
      {
+        if (head)
+          *head = _line_head_rows(ty, y_start,
+                                  (-y2_start - ty->backmax) * w2, w2);
         y_start += ((-y2_start - ty->backmax) * w2) / ty->w;
         x = ((-y2_start - ty->backmax) * w2) % ty->w;
         len_remaining -= (-y2_start - ty->backmax) * w2;
@@ -684,22 +885,25 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
 
    while (y <= y_end)
      {
+        if (y == y_end)
+          len = len_last;
+        else
+          len = ty->w;
         if (y >= 0)
           {
              line = &TERMPTY_SCREEN(ty, 0, y);
+             line[len - 1].att.autowrapped = 0;
           }
         else
           {
-             ts = termpty_save_extract(ty->back[(y + ty->backpos +
-                                                 ty->backmax) % ty->backmax]);
-             ty->back[(y + ty->backpos + ty->backmax) % ty->backmax] = ts;
-             line = ts->cell;
+             // the old rows all go once done, no need to take them out of
+             // their compressed copy. they are only read, the copy of the
+             // last cell loses its wrap flag instead
+             line = termpty_save_cells_get(ty->back[(y + ty->backpos +
+                                                     ty->backmax) %
+                                                    ty->backmax], &w);
+             if (!line) break;
           }
-        if (y == y_end)
-          len = len_last;
-        else
-          len = ty->w;
-        line[len - 1].att.autowrapped = 0;
         while (x < len)
           {
              copy_width = MIN(len - x, w2 - x2);
@@ -723,6 +927,8 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
                   x += copy_width;
                   x2 += copy_width;
                   len_remaining -= copy_width;
+                  if ((y < 0) && (x == len))
+                    line2[x2 - 1].att.autowrapped = 0;
                   if ((x2 == w2) && (y2 != y2_end))
                     {
                        line2[x2 - 1].att.autowrapped = 1;
@@ -744,7 +950,9 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
    Termcell *new_screen;
    Termsave **new_back;
    int y_start, y_end, new_y_start = 0, new_y_end;
-   int i, altbuf = 0;
+   int i, slot, altbuf = 0;
+   Eina_List *head = NULL;
+   Termsave *ts;
 
    if ((ty->w == new_w) && (ty->h == new_h)) return;
    if ((new_w == new_h) && (new_w == 1)) return; // FIXME: something weird is
@@ -776,14 +984,45 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
 
    y_end = ty->state.cy;
    new_y_end = new_h - 1;
-   while ((y_end >= -ty->backscroll_num) && (new_y_end >= -ty->backmax))
+   // the screen and the newest history first, older lines are left for
+   // termpty_reflow_step() unless back[] is full by then
+   while ((y_end >= -ty->backscroll_num) && (new_y_end >= -ty->backmax) &&
+          ((y_end >= 0) || (new_y_end >= -REFLOW_MARGIN)))
      {
         y_start = termpty_line_find_top(ty, y_end);
-        new_y_start = termpty_line_rewrap(ty, y_start, y_end, new_screen,
-                                        new_back, new_w, new_y_end);
+        // a line of one saved row that still fits is kept as it is, most
+        // likely compressed, only wrapped lines get their cells copied
+        slot = -1;
+        if ((y_start == y_end) && (y_end < 0) && (new_y_end < 0))
+          slot = (y_end + ty->backpos + ty->backmax) % ty->backmax;
+        if ((slot >= 0) && (termpty_save_width(ty->back[slot]) <= new_w))
+          {
+             new_back[new_y_end + ty->backmax] = ty->back[slot];
+             ty->back[slot] = NULL;
+             new_y_start = new_y_end;
+          }
+        else
+          new_y_start = termpty_line_rewrap(ty, y_start, y_end, new_screen,
+                                            new_back, new_w, new_y_end,
+                                            ty->spill ? &head : NULL);
         y_end = y_start - 1;
         new_y_end = new_y_start - 1;
      }
+   // lines waiting from an earlier resize are older still, they go first
+   if (new_y_end < -ty->backmax) termpty_reflow_drop(ty);
+   else if (y_end >= -ty->backscroll_num)
+     _reflow_queue(ty, -ty->backscroll_num, y_end);
+   if (ty->spill)
+     {
+        // what did not fit is older than what did, the lines left over go
+        // first and then the start of the line that was cut short
+        _resize_spill_rows(ty, -ty->backscroll_num, y_end);
+        EINA_LIST_FREE(head, ts)
+          {
+             termpty_save_spill(ty, ts);
+             termpty_save_free(ts);
+          }
+     }
 
    free(ty->screen);
    for (i = 1; i <= ty->backscroll_num; i++)
@@ -801,6 +1040,10 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
    ty->state.had_cr = 0;
    ty->screen = new_screen;
    ty->back = new_back;
+   termpty_save_rescan(ty);
+   free(ty->dirty.rows);
+   ty->dirty.rows = calloc(1, new_h);
+   termpty_dirty_all(ty);
 
    if (altbuf) termpty_screen_swap(ty);
 
@@ -810,9 +1053,168 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
 
    _pty_size(ty);
 
+   if (ty->reflow.num) termpty_save_more();
    termpty_save_thaw();
 }
 
+/* a line older than back[] rewrapped to the current width, oldest row
+ * first. its old rows are freed */
+static Eina_List *
+_reflow_line(Termpty *ty, Termsave **rows, int n)
+{
+   Eina_List *l, *pieces = NULL;
+   Termsave *ts = NULL;
+   Termcell *cells;
+   int i, x, c, w, x2 = 0, left = 0;
+
+   for (i = 0; i < n; i++) left += termpty_save_width(rows[i]);
+   if (!left)
+     {
+        ts = termpty_save_new(0);
+        if (ts) pieces = eina_list_append(pieces, ts);
+     }
+   for (i = 0; i < n; i++)
+     {
+        w = termpty_save_width(rows[i]);
+        cells = termpty_save_cells_get(rows[i], &w);
+        for (x = 0; x < w; x += c)
+          {
+             if ((!ts) || (x2 == ts->w))
+               {
+                  ts = termpty_save_new(MIN(left, ty->w));
+                  if (!ts)
+                    {
+                       ERR("memerr");
+                       for (; i < n; i++)
+                         {
+                            termpty_save_free(rows[i]);
+                            rows[i] = NULL;
+                         }
+                       goto done;
+                    }
+                  pieces = eina_list_append(pieces, ts);
+                  x2 = 0;
+               }
+             c = MIN(w - x, ts->w - x2);
+             if (cells)
+               memcpy(ts->cell + x2, cells + x, c * sizeof(Termcell));
+             else
+               memset(ts->cell + x2, 0, c * sizeof(Termcell));
+             x2 += c;
+             left -= c;
+          }
+        termpty_save_free(rows[i]);
+        rows[i] = NULL;
+     }
+done:
+   EINA_LIST_FOREACH(pieces, l, ts)
+     {
+        for (x = 0; x < ts->w; x++) ts->cell[x].att.autowrapped = 0;
+        if ((l->next) && (ts->w > 0)) ts->cell[ts->w - 1].att.autowrapped = 1;
+     }
+   return pieces;
+}
+
+// a row that fits in back[] no more goes on to disk if it can
+static void
+_reflow_row_out(Termpty *ty, Termsave *ts)
+{
+   Termsave *ts2;
+
+   if (ty->spill)
+     {
+        ts2 = termpty_save_extract(ts);
+        // a row that cannot be decompressed is only dropped
+        if (ts2)
+          {
+             termpty_save_spill(ty, ts2);
+             ts = ts2;
+          }
+     }
+   termpty_save_free(ts);
+}
+
+// put a row in back[] above all the others
+static void
+_reflow_prepend(Termpty *ty, Termsave *ts)
+{
+   int slot = (ty->backpos - ty->backscroll_num - 1 + ty->backmax) %
+     ty->backmax;
+
+   ty->back[slot] = ts;
+   ty->backscroll_num++;
+   termpty_save_queue(ty, slot);
+}
+
+/* a resize reflows the history only up to REFLOW_MARGIN rows above the
+ * screen, the older lines are rewrapped from the compressor's idler,
+ * newest first, and put back on top of back[] as long as there is room.
+ * returns whether some are left once the time is up */
+Eina_Bool
+termpty_reflow_step(Termpty *ty, double t_end)
+{
+   Eina_List *pieces;
+   Termsave *ts;
+   int start, end, n = 0;
+   Eina_Bool more = EINA_FALSE;
+
+   while (ty->reflow.num > 0)
+     {
+        if (((n++ & 0x3f) == 0x3f) && (ecore_time_get() > t_end))
+          {
+             more = EINA_TRUE;
+             break;
+          }
+        if ((!ty->back) || (ty->backscroll_num >= ty->backmax))
+          {
+             termpty_reflow_drop(ty);
+             break;
+          }
+        end = ty->reflow.num - 1;
+        start = end;
+        while ((start > 0) && (termpty_save_wrapped(ty->reflow.rows[start - 1])))
+          start--;
+        // a line of one row that fits is kept as it is, as in a resize
+        if ((start == end) &&
+            (termpty_save_width(ty->reflow.rows[end]) <= ty->w))
+          {
+             _reflow_prepend(ty, ty->reflow.rows[end]);
+             ty->reflow.num--;
+             continue;
+          }
+        pieces = _reflow_line(ty, ty->reflow.rows + start, end - start + 1);
+        ty->reflow.num = start;
+        while ((pieces) && (ty->backscroll_num < ty->backmax))
+          {
+             ts = eina_list_last_data_get(pieces);
+             pieces = eina_list_remove_list(pieces, eina_list_last(pieces));
+             _reflow_prepend(ty, ts);
+          }
+        if (pieces)
+          {
+             // back[] is full, what is older than the start of this line
+             // goes out first
+             termpty_reflow_drop(ty);
+             EINA_LIST_FREE(pieces, ts) _reflow_row_out(ty, ts);
+          }
+     }
+   if (!ty->reflow.num) _reflow_free(ty);
+   if (ty->obj) termio_backscroll_drop(ty->obj);
+   return more;
+}
+
+void
+termpty_reflow_drop(Termpty *ty)
+{
+   int i;
+
+   // back[] got full first, oldest first like any row leaving it
+   for (i = 0; i < ty->reflow.num; i++)
+     _reflow_row_out(ty, ty->reflow.rows[i]);
+   ty->reflow.num = 0;
+   _reflow_free(ty);
+}
+
 void
 termpty_backscroll_set(Termpty *ty, int size)
 {
@@ -837,9 +1239,30 @@ termpty_backscroll_set(Termpty *ty, int size)
    ty->backscroll_num = 0;
    ty->backpos = 0;
    ty->backmax = size;
+   termpty_save_rescan(ty);
+   _reflow_free(ty);
+   // the lines on disk followed on from back[], start them afresh too
+   if (ty->spill)
+     {
+        termpty_save_spill_set(ty, EINA_FALSE);
+        termpty_save_spill_set(ty, EINA_TRUE);
+     }
    termpty_save_thaw();
 }
 
+int
+termpty_backscroll_num_get(const Termpty *ty)
+{
+   return ty->backscroll_num + ty->reflow.num + termpty_save_spill_rows(ty);
+}
+
+void
+termpty_latency_set(Termpty *ty, int ms)
+{
+   if (ms < 1) ms = 1;
+   ty->latency = (double)ms / 1000.0;
+}
+
 pid_t
 termpty_pid_get(const Termpty *ty)
 {
@@ -931,6 +1354,14 @@ termpty_block_get(Termpty *ty, int id)
    return eina_hash_find(ty->block.blocks, &id);
 }
 
+/* a block leaves the hash once no cell refers to it anymore, so without
+ * blocks no cell can hold a placeholder and cells copy without refcounting */
+Eina_Bool
+termpty_block_any(const Termpty *ty)
+{
+   return ((ty->block.blocks) && (eina_hash_population(ty->block.blocks) > 0));
+}
+
 void
 termpty_block_chid_update(Termpty *ty, Termblock *blk)
 {
@@ -993,7 +1424,23 @@ void
 termpty_cell_copy(Termpty *ty, Termcell *src, Termcell *dst, int n)
 {
    int i;
-   
+
+   if (n <= 0) return;
+   if (!termpty_block_any(ty))
+     {
+        memmove(dst, src, n * sizeof(Termcell));
+        return;
+     }
+   // moving cells right within a row has to start from the end
+   if ((dst > src) && (dst < src + n))
+     {
+        for (i = n - 1; i >= 0; i--)
+          {
+             _handle_block_codepoint_overwrite(ty, dst[i].codepoint, src[i].codepoint);
+             dst[i] = src[i];
+          }
+        return;
+     }
    for (i = 0; i < n; i++)
      {
         _handle_block_codepoint_overwrite(ty, dst[i].codepoint, src[i].codepoint);
@@ -1024,6 +1471,7 @@ termpty_screen_swap(Termpty *ty)
    ty->state.appcursor = tmp_appcursor;
 
    ty->altbuf = !ty->altbuf;
+   termpty_dirty_all(ty);
 
    if (ty->cb.cancel_sel.func)
      ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
@@ -1034,6 +1482,17 @@ termpty_cell_fill(Termpty *ty, Termcell *src, Termcell *dst, int n)
 {
    int i;
 
+   if (n <= 0) return;
+   if (!termpty_block_any(ty))
+     {
+        if (src)
+          {
+             for (i = 0; i < n; i++) dst[i] = src[0];
+          }
+        else
+          memset(dst, 0, n * sizeof(Termcell));
+        return;
+     }
    if (src)
      {
         for (i = 0; i < n; i++)
@@ -1058,7 +1517,12 @@ termpty_cell_codepoint_att_fill(Termpty *ty, Eina_Unicode codepoint,
 {
    Termcell local = { codepoint, att };
    int i;
-   
+
+   if (!termpty_block_any(ty))
+     {
+        for (i = 0; i < n; i++) dst[i] = local;
+        return;
+     }
    for (i = 0; i < n; i++)
      {
         _handle_block_codepoint_overwrite(ty, dst[i].codepoint, codepoint);
@@ -2,13 +2,18 @@
 #define _TERMPTY_H__ 1
 
 #include "config.h"
+#include "utf8.h"
 
 typedef struct _Termpty       Termpty;
 typedef struct _Termcell      Termcell;
 typedef struct _Termatt       Termatt;
 typedef struct _Termstate     Termstate;
+typedef struct _Termparser    Termparser;
 typedef struct _Termsave      Termsave;
 typedef struct _Termsavecomp  Termsavecomp;
+typedef struct _Termsaveref   Termsaveref;
+typedef struct _Termsavechunk Termsavechunk;
+typedef struct _Termspill     Termspill;
 typedef struct _Termblock     Termblock;
 typedef struct _Termexp       Termexp;
 
@@ -45,33 +50,34 @@ typedef struct _Termexp       Termexp;
 // Only for testing purpose
 //#define SUPPORT_80_132_COLUMNS 1
 
+/* packed in 32 bits so a Termcell is 8 bytes, mind that when adding bits */
 struct _Termatt
 {
-   unsigned char fg, bg;
-   unsigned short bold : 1;
-   unsigned short faint : 1;
+   unsigned int fg : 8;
+   unsigned int bg : 8;
+   unsigned int bold : 1;
+   unsigned int faint : 1;
 #if defined(SUPPORT_ITALIC)
-   unsigned short italic : 1;
+   unsigned int italic : 1;
 #elif defined(SUPPORT_DBLWIDTH)
-   unsigned short dblwidth : 1;
-#endif   
-   unsigned short underline : 1;
-   unsigned short blink : 1; // don't intend to support this currently
-   unsigned short blink2 : 1; // don't intend to support this currently
-   unsigned short inverse : 1;
-   unsigned short invisible : 1;
-   unsigned short strike : 1;
-   unsigned short fg256 : 1;
-   unsigned short bg256 : 1;
-   unsigned short fgintense : 1;
-   unsigned short bgintense : 1;
+   unsigned int dblwidth : 1;
+#endif
+   unsigned int underline : 1;
+   unsigned int blink : 1; // slow or rapid, don't intend to support this currently
+   unsigned int inverse : 1;
+   unsigned int invisible : 1;
+   unsigned int strike : 1;
+   unsigned int fg256 : 1;
+   unsigned int bg256 : 1;
+   unsigned int fgintense : 1;
+   unsigned int bgintense : 1;
    // below used for working out text from selections
-   unsigned short autowrapped : 1;
-   unsigned short newline : 1;
-   unsigned short tab : 1;
-   unsigned short fraktur : 1;
+   unsigned int autowrapped : 1;
+   unsigned int newline : 1;
+   unsigned int tab : 1;
+   unsigned int fraktur : 1;
 #if defined(SUPPORT_80_132_COLUMNS)
-   unsigned short is_80_132_mode_allowed : 1;
+   unsigned int is_80_132_mode_allowed : 1;
 #endif
 };
 
@@ -102,6 +108,37 @@ struct _Termstate
    unsigned int  bracketed_paste : 1;
 };
 
+#define TERMPTY_PARSER_ARGS_MAX 32
+
+typedef enum _Termparser_State
+{
+   TERMPTY_PARSE_GROUND = 0, // plain text
+   TERMPTY_PARSE_OSC, // ESC ] ... (BEL | ST)
+   TERMPTY_PARSE_DCS, // ESC P ... ST
+   TERMPTY_PARSE_TERMINOLOGY, // ESC } ... \0
+   TERMPTY_PARSE_STRING_ESC, // ESC inside an OSC or DCS string
+   TERMPTY_PARSE_ESCAPE, // table driven from here on
+   TERMPTY_PARSE_ESCAPE_CHARSET,
+   TERMPTY_PARSE_CSI_ENTRY,
+   TERMPTY_PARSE_CSI_PARAM,
+   TERMPTY_PARSE_CSI_INTERMEDIATE,
+   TERMPTY_PARSE_CSI_IGNORE
+} Termparser_State;
+
+struct _Termparser
+{
+   Termparser_State state; // kept from one read to the next
+   int          args[TERMPTY_PARSER_ARGS_MAX + 1]; // -1 if not given
+   int          argc; // index of the arg being read
+   Eina_Unicode leader, inter;
+   struct {
+      Eina_Unicode *buf;
+      int len, size;
+      Termparser_State state;
+      unsigned int skip : 1;
+   } str;
+};
+
 struct _Termpty
 {
    Evas_Object *obj;
@@ -119,15 +156,39 @@ struct _Termpty
    const char *cur_cmd;
    Termcell *screen, *screen2;
    Termsave **back;
-   unsigned char oldbuf[4];
-   int *buf;
-   int buflen;
+   Utf8_Decoder decoder;
+   Termparser parser;
+   struct {
+      Eina_Unicode *buf; // decoded input, reused from read to read
+      int size;
+   } input;
    int w, h;
    int fd, slavefd;
    int circular_offset;
    int circular_offset2;
+   struct {
+      unsigned char *rows; // screen rows changed since termio drew them
+      int scroll; // rows scroll_y1..scroll_y2 moved up meanwhile
+      int scroll_y1, scroll_y2;
+      Eina_Bool all : 1;
+   } dirty;
    int backmax, backpos;
    int backscroll_num;
+   struct {
+      int *slot; // back[] slots that may hold uncompressed rows
+      int num, size;
+      int fresh; // the newest rows, before backpos, not looked at yet
+      Eina_Bool rescan : 1; // slot[] got too long, redo it when idle
+   } backdirty;
+   struct {
+      size_t comp, uncomp; // bytes held by the rows in back[]
+   } backmem;
+   struct {
+      Termsave **rows; // older than back[] and not reflowed yet, oldest first
+      int num;
+   } reflow;
+   Termspill *spill; // where rows go after back[], if anywhere
+   double latency; // max time spent parsing before the screen may update
    struct {
       int curid;
       Eina_Hash *blocks;
@@ -160,22 +221,39 @@ struct _Termcell
 
 struct _Termsave
 {
-   unsigned int   gen  : 8;
-   unsigned int   comp : 1;
-   unsigned int   z    : 1;
-   unsigned int   w    : 22;
+   unsigned int   comp   : 1;
+   unsigned int   z      : 1;
+   unsigned int   ref    : 1;
+   unsigned int   cached : 1;
+   unsigned int   wrap   : 1;
+   unsigned int   w      : 27;
    Termcell       cell[1];
 };
 
 struct _Termsavecomp
 {
-   unsigned int   gen  : 8;
-   unsigned int   comp : 1;
-   unsigned int   z    : 1;
-   unsigned int   w    : 22; // compressed size in bytes
+   unsigned int   comp   : 1;
+   unsigned int   z      : 1;
+   unsigned int   ref    : 1;
+   unsigned int   cached : 1; // decompressed in the row cache
+   unsigned int   wrap   : 1; // last cell autowrapped, kept out of the cells
+   unsigned int   w      : 27; // compressed size in bytes
    unsigned int   wout; // output width in Termcells
 };
 
+// a row compressed along with its neighbours in a Termsavechunk
+struct _Termsaveref
+{
+   unsigned int   comp   : 1;
+   unsigned int   z      : 1;
+   unsigned int   ref    : 1;
+   unsigned int   cached : 1;
+   unsigned int   wrap   : 1;
+   unsigned int   w      : 27; // unused
+   unsigned int   row; // index in the chunk
+   Termsavechunk *chunk;
+};
+
 struct _Termblock
 {
    Termpty     *pty;
@@ -214,9 +292,17 @@ void       termpty_free(Termpty *ty);
 void       termpty_cellcomp_freeze(Termpty *ty);
 void       termpty_cellcomp_thaw(Termpty *ty);
 Termcell  *termpty_cellrow_get(Termpty *ty, int y, int *wret);
+void       termpty_dirty_rows(Termpty *ty, int y1, int y2);
+void       termpty_dirty_scroll(Termpty *ty, int y1, int y2, int n);
+void       termpty_dirty_all(Termpty *ty);
+void       termpty_dirty_clear(Termpty *ty);
 void       termpty_write(Termpty *ty, const char *input, int len);
 void       termpty_resize(Termpty *ty, int w, int h);
+Eina_Bool  termpty_reflow_step(Termpty *ty, double t_end);
+void       termpty_reflow_drop(Termpty *ty);
 void       termpty_backscroll_set(Termpty *ty, int size);
+int        termpty_backscroll_num_get(const Termpty *ty);
+void       termpty_latency_set(Termpty *ty, int ms);
 
 pid_t      termpty_pid_get(const Termpty *ty);
 void       termpty_block_free(Termblock *tb);
@@ -224,6 +310,7 @@ Termblock *termpty_block_new(Termpty *ty, int w, int h, const char *path, const
 void       termpty_block_insert(Termpty *ty, int ch, Termblock *blk);
 int        termpty_block_id_get(Termcell *cell, int *x, int *y);
 Termblock *termpty_block_get(Termpty *ty, int id);
+Eina_Bool  termpty_block_any(const Termpty *ty);
 void       termpty_block_chid_update(Termpty *ty, Termblock *blk);
 Termblock *termpty_block_chid_get(Termpty *ty, const char *chid);
 
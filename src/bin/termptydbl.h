@@ -1,26 +1,44 @@
 #ifndef _TERMPTY_DBL_H__
 #define _TERMPTY_DBL_H__ 1
 
-Eina_Bool _termpty_is_dblwidth_slow_get(Termpty *ty, int g);
+// east asian width classes, see termptydbl_data.c
+#define TERMPTY_WIDTH_NARROW    0 // narrow (Na), half-width (H), neutral (N)
+#define TERMPTY_WIDTH_WIDE      1 // wide (W), full-width (F)
+#define TERMPTY_WIDTH_AMBIGUOUS 2 // ambiguous (A)
+#define TERMPTY_WIDTH_ZERO      3 // combining marks and format chars
+
+// two level table: 256 codepoints per block, 2 bits per codepoint
+extern const unsigned char _termpty_width_index[0x110000 >> 8];
+extern const unsigned char _termpty_width_blocks[][64];
+
+static inline int
+_termpty_width_class_get(int g)
+{
+   unsigned char b;
+
+   if ((g < 0) || (g > 0x10ffff)) return TERMPTY_WIDTH_NARROW;
+   b = _termpty_width_blocks[_termpty_width_index[g >> 8]][(g & 0xff) >> 2];
+   return (b >> ((g & 0x3) << 1)) & 0x3;
+}
 
 static inline Eina_Bool
 _termpty_is_dblwidth_get(Termpty *ty, int g)
 {
 #if defined(SUPPORT_DBLWIDTH)
-   // check for east asian full-width (F), half-width (H), wide (W),
-   // narrow (Na) or ambiguous (A) codepoints
    // ftp://ftp.unicode.org/Public/UNIDATA/EastAsianWidth.txt
 
    // optimize for latin1 non-ambiguous
    if (g <= 0xa0)
      return EINA_FALSE;
-   // (F)
-   if ((g == 0x3000) ||
-       ((g >= 0xff01) && (g <= 0xff60)) ||
-       ((g >= 0xffe0) && (g <= 0xffe6)))
-     return EINA_TRUE;
-
-   return _termpty_is_dblwidth_slow_get(ty, g);
+   switch (_termpty_width_class_get(g))
+     {
+      case TERMPTY_WIDTH_WIDE:
+        return EINA_TRUE;
+      case TERMPTY_WIDTH_AMBIGUOUS:
+        return ty->state.cjk_ambiguous_wide;
+      default:
+        return EINA_FALSE;
+     }
 #else
    return EINA_FALSE;
 #endif
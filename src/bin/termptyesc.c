@@ -24,37 +24,129 @@
 #define ST 0x9c // String Terminator
 #define BEL 0x07 // Bell
 #define ESC 033 // Escape
+#define CSI 0x9b // Control Sequence Introducer
 
-/* XXX: all handle_ functions return the number of bytes successfully read, 0
- * if not enought bytes could be read
+// osc and dcs strings longer than this are dropped, they are never sane
+#define STRING_MAX 4096
+
+/* The escape parser is a VT500 style state machine (see
+ * http://vt100.net/emu/dec_ansi_parser). Every codepoint is looked at
+ * once, and the state, csi args and string being collected survive
+ * between reads, so a sequence split over several reads costs nothing
+ * extra. Escape and csi sequences are driven by the tables below, strings
+ * and plain text are scanned in bulk.
  */
+enum
+{
+   ACT_NONE = 0,
+   ACT_EXECUTE, // c0 control
+   ACT_COLLECT, // intermediate char
+   ACT_LEADER, // private marker like '?' or '>'
+   ACT_PARAM, // csi arg digit
+   ACT_PARAM_NEXT, // csi arg separator
+   ACT_ESC_DISPATCH,
+   ACT_CSI_START,
+   ACT_CSI_DISPATCH,
+   ACT_STR_START
+};
+
+#define T(act, st) (((act) << 4) | (st))
+#define TABLE_FIRST TERMPTY_PARSE_ESCAPE
+#define TABLE_STATES (TERMPTY_PARSE_CSI_IGNORE - TABLE_FIRST + 1)
+#define TABLE_HIGH 0x80 // everything from 0x80 up
+
+// c0 controls execute right away, except CAN/SUB abort and ESC restarts
+#define C0(st) \
+   [0x00 ... 0x17] = T(ACT_EXECUTE, st), \
+   [0x18]          = T(ACT_NONE, TERMPTY_PARSE_GROUND), \
+   [0x19]          = T(ACT_EXECUTE, st), \
+   [0x1a]          = T(ACT_NONE, TERMPTY_PARSE_GROUND), \
+   [0x1b]          = T(ACT_NONE, TERMPTY_PARSE_ESCAPE), \
+   [0x1c ... 0x1f] = T(ACT_EXECUTE, st)
+
+#define CSI_PARAMS(st, leader) \
+   [0x20 ... 0x2f] = T(ACT_COLLECT, TERMPTY_PARSE_CSI_INTERMEDIATE), \
+   [0x30 ... 0x39] = T(ACT_PARAM, TERMPTY_PARSE_CSI_PARAM), \
+   [0x3a ... 0x3b] = T(ACT_PARAM_NEXT, TERMPTY_PARSE_CSI_PARAM), \
+   [0x3c ... 0x3f] = leader, \
+   [0x40 ... 0x7e] = T(ACT_CSI_DISPATCH, TERMPTY_PARSE_GROUND), \
+   [0x7f]          = T(ACT_NONE, st), \
+   [TABLE_HIGH]    = T(ACT_NONE, TERMPTY_PARSE_GROUND)
 
-static int
-_csi_arg_get(Eina_Unicode **ptr)
+static const unsigned char _transitions[TABLE_STATES][TABLE_HIGH + 1] =
 {
-   Eina_Unicode *b = *ptr;
-   int sum = 0;
+   [TERMPTY_PARSE_ESCAPE - TABLE_FIRST] = {
+      C0(TERMPTY_PARSE_ESCAPE),
+      [0x20 ... 0x22] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x23 ... 0x24] = T(ACT_COLLECT, TERMPTY_PARSE_ESCAPE_CHARSET), // # $
+      [0x25 ... 0x27] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x28 ... 0x2b] = T(ACT_COLLECT, TERMPTY_PARSE_ESCAPE_CHARSET), // ( ) * +
+      [0x2c ... 0x3f] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x40]          = T(ACT_COLLECT, TERMPTY_PARSE_ESCAPE_CHARSET), // @
+      [0x41 ... 0x4f] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x50]          = T(ACT_STR_START, TERMPTY_PARSE_DCS), // P
+      [0x51 ... 0x5a] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x5b]          = T(ACT_CSI_START, TERMPTY_PARSE_CSI_ENTRY), // [
+      [0x5c]          = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x5d]          = T(ACT_STR_START, TERMPTY_PARSE_OSC), // ]
+      [0x5e ... 0x7c] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x7d]          = T(ACT_STR_START, TERMPTY_PARSE_TERMINOLOGY), // }
+      [0x7e]          = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x7f]          = T(ACT_NONE, TERMPTY_PARSE_ESCAPE),
+      [TABLE_HIGH]    = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND)
+   },
+   [TERMPTY_PARSE_ESCAPE_CHARSET - TABLE_FIRST] = {
+      C0(TERMPTY_PARSE_ESCAPE_CHARSET),
+      [0x20 ... 0x7e] = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x7f]          = T(ACT_NONE, TERMPTY_PARSE_ESCAPE_CHARSET),
+      [TABLE_HIGH]    = T(ACT_ESC_DISPATCH, TERMPTY_PARSE_GROUND)
+   },
+   [TERMPTY_PARSE_CSI_ENTRY - TABLE_FIRST] = {
+      C0(TERMPTY_PARSE_CSI_ENTRY),
+      CSI_PARAMS(TERMPTY_PARSE_CSI_ENTRY,
+                 T(ACT_LEADER, TERMPTY_PARSE_CSI_PARAM))
+   },
+   [TERMPTY_PARSE_CSI_PARAM - TABLE_FIRST] = {
+      C0(TERMPTY_PARSE_CSI_PARAM),
+      CSI_PARAMS(TERMPTY_PARSE_CSI_PARAM,
+                 T(ACT_NONE, TERMPTY_PARSE_CSI_IGNORE))
+   },
+   [TERMPTY_PARSE_CSI_INTERMEDIATE - TABLE_FIRST] = {
+      C0(TERMPTY_PARSE_CSI_INTERMEDIATE),
+      [0x20 ... 0x2f] = T(ACT_COLLECT, TERMPTY_PARSE_CSI_INTERMEDIATE),
+      [0x30 ... 0x3f] = T(ACT_NONE, TERMPTY_PARSE_CSI_IGNORE),
+      [0x40 ... 0x7e] = T(ACT_CSI_DISPATCH, TERMPTY_PARSE_GROUND),
+      [0x7f]          = T(ACT_NONE, TERMPTY_PARSE_CSI_INTERMEDIATE),
+      [TABLE_HIGH]    = T(ACT_NONE, TERMPTY_PARSE_GROUND)
+   },
+   [TERMPTY_PARSE_CSI_IGNORE - TABLE_FIRST] = {
+      C0(TERMPTY_PARSE_CSI_IGNORE),
+      [0x20 ... 0x3f] = T(ACT_NONE, TERMPTY_PARSE_CSI_IGNORE),
+      [0x40 ... 0x7e] = T(ACT_NONE, TERMPTY_PARSE_GROUND),
+      [0x7f]          = T(ACT_NONE, TERMPTY_PARSE_CSI_IGNORE),
+      [TABLE_HIGH]    = T(ACT_NONE, TERMPTY_PARSE_GROUND)
+   }
+};
 
-   while ((*b) && (!isdigit(*b))) b++;
-   if (!*b)
-     {
-        *ptr = NULL;
-        return 0;
-     }
-   while (isdigit(*b))
-     {
-        sum *= 10;
-        sum += *b - '0';
-        b++;
-     }
-   *ptr = b;
-   return sum;
+/* csi args are read in place as the digits come in. an arg that was not
+ * given (or not even separated) reads as -1 */
+static inline int
+_csi_arg_count(const Termpty *ty)
+{
+   return MIN(ty->parser.argc + 1, TERMPTY_PARSER_ARGS_MAX);
+}
+
+static inline int
+_csi_arg_get(const Termpty *ty, int i)
+{
+   if (i >= _csi_arg_count(ty)) return -1;
+   return ty->parser.args[i];
 }
 
 static void
-_handle_cursor_control(Termpty *ty, const Eina_Unicode *cc)
+_handle_cursor_control(Termpty *ty, Eina_Unicode cc)
 {
-   switch (*cc)
+   switch (cc)
      {
       case 0x07: // BEL '\a' (bell)
          ty->state.had_cr = 0;
@@ -109,268 +201,243 @@ _handle_cursor_control(Termpty *ty, const Eina_Unicode *cc)
 }
 
 static void
-_handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
+_handle_esc_csi_color_set(Termpty *ty)
 {
-   Eina_Unicode *b = *ptr;
-   int first = 1;
+   int i, n = _csi_arg_count(ty);
 
-   if (b && (*b == '>'))
+   if (ty->parser.leader == '>')
      { // key resources used by xterm
         ERR("TODO: set/reset key resources used by xterm");
         return;
      }
    DBG("color set");
-   while (b)
+   for (i = 0; i < n; i++)
      {
-        int arg = _csi_arg_get(&b);
-        if ((first) && (!b))
-          _termpty_reset_att(&(ty->state.att));
-        else if (b)
+        int arg = _csi_arg_get(ty, i);
+
+        // an empty arg is a 0 - reset
+        if (arg < 0) arg = 0;
+        switch (arg)
           {
-             first = 0;
-             switch (arg)
-               {
-                case 0: // reset to normal
-                   _termpty_reset_att(&(ty->state.att));
-                   break;
-                case 1: // bold/bright
-                   ty->state.att.bold = 1;
-                   break;
-                case 2: // faint
-                   ty->state.att.faint = 1;
-                   break;
-                case 3: // italic
+           case 0: // reset to normal
+              _termpty_reset_att(&(ty->state.att));
+              break;
+           case 1: // bold/bright
+              ty->state.att.bold = 1;
+              break;
+           case 2: // faint
+              ty->state.att.faint = 1;
+              break;
+           case 3: // italic
 #if defined(SUPPORT_ITALIC)
-                   ty->state.att.italic = 1;
+              ty->state.att.italic = 1;
 #endif
-                   break;
-                case 4: // underline
-                   ty->state.att.underline = 1;
-                   break;
-                case 5: // blink
-                   ty->state.att.blink = 1;
-                   break;
-                case 6: // blink rapid
-                   ty->state.att.blink2 = 1;
-                   break;
-                case 7: // reverse
-                   ty->state.att.inverse = 1;
-                   break;
-                case 8: // invisible
-                   ty->state.att.invisible = 1;
-                   break;
-                case 9: // strikethrough
-                   ty->state.att.strike = 1;
-                   break;
-                case 20: // fraktur!
-                   ty->state.att.fraktur = 1;
-                   break;
-                case 21: // no bold/bright
-                   ty->state.att.bold = 0;
-                   break;
-                case 22: // no bold/bright, no faint
-                   ty->state.att.bold = 0;
-                   ty->state.att.faint = 0;
-                   break;
-                case 23: // no italic, not fraktur
+              break;
+           case 4: // underline
+              ty->state.att.underline = 1;
+              break;
+           case 5: // blink
+              ty->state.att.blink = 1;
+              break;
+           case 6: // blink rapid
+              ty->state.att.blink = 1;
+              break;
+           case 7: // reverse
+              ty->state.att.inverse = 1;
+              break;
+           case 8: // invisible
+              ty->state.att.invisible = 1;
+              break;
+           case 9: // strikethrough
+              ty->state.att.strike = 1;
+              break;
+           case 20: // fraktur!
+              ty->state.att.fraktur = 1;
+              break;
+           case 21: // no bold/bright
+              ty->state.att.bold = 0;
+              break;
+           case 22: // no bold/bright, no faint
+              ty->state.att.bold = 0;
+              ty->state.att.faint = 0;
+              break;
+           case 23: // no italic, not fraktur
 #if defined(SUPPORT_ITALIC)
-                   ty->state.att.italic = 0;
+              ty->state.att.italic = 0;
 #endif
-                   ty->state.att.fraktur = 0;
-                   break;
-                case 24: // no underline
-                   ty->state.att.underline = 0;
-                   break;
-                case 25: // no blink
-                   ty->state.att.blink = 0;
-                   ty->state.att.blink2 = 0;
-                   break;
-                case 27: // no reverse
-                   ty->state.att.inverse = 0;
-                   break;
-                case 28: // no invisible
-                   ty->state.att.invisible = 0;
-                   break;
-                case 29: // no strikethrough
-                   ty->state.att.strike = 0;
-                   break;
-                case 30: // fg
-                case 31:
-                case 32:
-                case 33:
-                case 34:
-                case 35:
-                case 36:
-                case 37:
-                   ty->state.att.fg256 = 0;
-                   ty->state.att.fg = (arg - 30) + COL_BLACK;
-                   ty->state.att.fgintense = 0;
-                   break;
-                case 38: // xterm 256 fg color ???
-                   // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
+              ty->state.att.fraktur = 0;
+              break;
+           case 24: // no underline
+              ty->state.att.underline = 0;
+              break;
+           case 25: // no blink
+              ty->state.att.blink = 0;
+              break;
+           case 27: // no reverse
+              ty->state.att.inverse = 0;
+              break;
+           case 28: // no invisible
+              ty->state.att.invisible = 0;
+              break;
+           case 29: // no strikethrough
+              ty->state.att.strike = 0;
+              break;
+           case 30: // fg
+           case 31:
+           case 32:
+           case 33:
+           case 34:
+           case 35:
+           case 36:
+           case 37:
+              ty->state.att.fg256 = 0;
+              ty->state.att.fg = (arg - 30) + COL_BLACK;
+              ty->state.att.fgintense = 0;
+              break;
+           case 38: // xterm 256 fg color ???
+              // now check if next arg is 5
+              arg = _csi_arg_get(ty, ++i);
+              if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
+              else
+                {
+                   // then get next arg - should be color index 0-255
+                   arg = _csi_arg_get(ty, ++i);
+                   if (arg < 0) ERR("Failed xterm 256 color fg esc val");
                    else
                      {
-                        // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color fg esc val");
-                        else
-                          {
-                             ty->state.att.fg256 = 1;
-                             ty->state.att.fg = arg;
-                          }
+                        ty->state.att.fg256 = 1;
+                        ty->state.att.fg = arg;
                      }
-                   ty->state.att.fgintense = 0;
-                   break;
-                case 39: // default fg color
-                   ty->state.att.fg256 = 0;
-                   ty->state.att.fg = COL_DEF;
-                   ty->state.att.fgintense = 0;
-                   break;
-                case 40: // bg
-                case 41:
-                case 42:
-                case 43:
-                case 44:
-                case 45:
-                case 46:
-                case 47:
-                   ty->state.att.bg256 = 0;
-                   ty->state.att.bg = (arg - 40) + COL_BLACK;
-                   ty->state.att.bgintense = 0;
-                   break;
-                case 48: // xterm 256 bg color ???
-                   // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
+                }
+              ty->state.att.fgintense = 0;
+              break;
+           case 39: // default fg color
+              ty->state.att.fg256 = 0;
+              ty->state.att.fg = COL_DEF;
+              ty->state.att.fgintense = 0;
+              break;
+           case 40: // bg
+           case 41:
+           case 42:
+           case 43:
+           case 44:
+           case 45:
+           case 46:
+           case 47:
+              ty->state.att.bg256 = 0;
+              ty->state.att.bg = (arg - 40) + COL_BLACK;
+              ty->state.att.bgintense = 0;
+              break;
+           case 48: // xterm 256 bg color ???
+              // now check if next arg is 5
+              arg = _csi_arg_get(ty, ++i);
+              if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
+              else
+                {
+                   // then get next arg - should be color index 0-255
+                   arg = _csi_arg_get(ty, ++i);
+                   if (arg < 0) ERR("Failed xterm 256 color bg esc val");
                    else
                      {
-                        // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color bg esc val");
-                        else
-                          {
-                             ty->state.att.bg256 = 1;
-                             ty->state.att.bg = arg;
-                          }
+                        ty->state.att.bg256 = 1;
+                        ty->state.att.bg = arg;
                      }
-                   ty->state.att.bgintense = 0;
-                   break;
-                case 49: // default bg color
-                   ty->state.att.bg256 = 0;
-                   ty->state.att.bg = COL_DEF;
-                   ty->state.att.bgintense = 0;
-                   break;
-                case 90: // fg
-                case 91:
-                case 92:
-                case 93:
-                case 94:
-                case 95:
-                case 96:
-                case 97:
-                   ty->state.att.fg256 = 0;
-                   ty->state.att.fg = (arg - 90) + COL_BLACK;
-                   ty->state.att.fgintense = 1;
-                   break;
-                case 98: // xterm 256 fg color ???
-                   // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
+                }
+              ty->state.att.bgintense = 0;
+              break;
+           case 49: // default bg color
+              ty->state.att.bg256 = 0;
+              ty->state.att.bg = COL_DEF;
+              ty->state.att.bgintense = 0;
+              break;
+           case 90: // fg
+           case 91:
+           case 92:
+           case 93:
+           case 94:
+           case 95:
+           case 96:
+           case 97:
+              ty->state.att.fg256 = 0;
+              ty->state.att.fg = (arg - 90) + COL_BLACK;
+              ty->state.att.fgintense = 1;
+              break;
+           case 98: // xterm 256 fg color ???
+              // now check if next arg is 5
+              arg = _csi_arg_get(ty, ++i);
+              if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
+              else
+                {
+                   // then get next arg - should be color index 0-255
+                   arg = _csi_arg_get(ty, ++i);
+                   if (arg < 0) ERR("Failed xterm 256 color fg esc val");
                    else
                      {
-                        // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color fg esc val");
-                        else
-                          {
-                             ty->state.att.fg256 = 1;
-                             ty->state.att.fg = arg;
-                          }
+                        ty->state.att.fg256 = 1;
+                        ty->state.att.fg = arg;
                      }
-                   ty->state.att.fgintense = 1;
-                   break;
-                case 99: // default fg color
-                   ty->state.att.fg256 = 0;
-                   ty->state.att.fg = COL_DEF;
-                   ty->state.att.fgintense = 1;
-                   break;
-                case 100: // bg
-                case 101:
-                case 102:
-                case 103:
-                case 104:
-                case 105:
-                case 106:
-                case 107:
-                   ty->state.att.bg256 = 0;
-                   ty->state.att.bg = (arg - 100) + COL_BLACK;
-                   ty->state.att.bgintense = 1;
-                   break;
-                case 108: // xterm 256 bg color ???
-                   // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
+                }
+              ty->state.att.fgintense = 1;
+              break;
+           case 99: // default fg color
+              ty->state.att.fg256 = 0;
+              ty->state.att.fg = COL_DEF;
+              ty->state.att.fgintense = 1;
+              break;
+           case 100: // bg
+           case 101:
+           case 102:
+           case 103:
+           case 104:
+           case 105:
+           case 106:
+           case 107:
+              ty->state.att.bg256 = 0;
+              ty->state.att.bg = (arg - 100) + COL_BLACK;
+              ty->state.att.bgintense = 1;
+              break;
+           case 108: // xterm 256 bg color ???
+              // now check if next arg is 5
+              arg = _csi_arg_get(ty, ++i);
+              if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
+              else
+                {
+                   // then get next arg - should be color index 0-255
+                   arg = _csi_arg_get(ty, ++i);
+                   if (arg < 0) ERR("Failed xterm 256 color bg esc val");
                    else
                      {
-                        // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color bg esc val");
-                        else
-                          {
-                             ty->state.att.bg256 = 1;
-                             ty->state.att.bg = arg;
-                          }
+                        ty->state.att.bg256 = 1;
+                        ty->state.att.bg = arg;
                      }
-                   ty->state.att.bgintense = 1;
-                   break;
-                case 109: // default bg color
-                   ty->state.att.bg256 = 0;
-                   ty->state.att.bg = COL_DEF;
-                   ty->state.att.bgintense = 1;
-                   break;
-                default: //  not handled???
-                   ERR("  color cmd [%i] not handled", arg);
-                   break;
-               }
+                }
+              ty->state.att.bgintense = 1;
+              break;
+           case 109: // default bg color
+              ty->state.att.bg256 = 0;
+              ty->state.att.bg = COL_DEF;
+              ty->state.att.bgintense = 1;
+              break;
+           default: //  not handled???
+              ERR("  color cmd [%i] not handled", arg);
+              break;
           }
      }
 }
 
-static int
-_handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
+static void
+_handle_esc_csi(Termpty *ty, Eina_Unicode cc)
 {
    int arg, i;
-   const Eina_Unicode *cc, *be;
-   Eina_Unicode buf[4096], *b;
 
-   cc = (Eina_Unicode *)c;
-   b = buf;
-   be = buf + sizeof(buf) / sizeof(buf[0]);
-   while ((cc < ce) && (*cc <= '?') && (b < be))
-     {
-        _handle_cursor_control(ty, cc);
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if (b == be)
-     {
-        ERR("csi parsing overflowed, skipping the whole buffer (binary data?)");
-        return cc - c;
-     }
-   if (cc == ce) return 0;
-   *b = 0;
-   b = buf;
-   DBG(" CSI: '%c' args '%s'", *cc, (char *) buf);
-   switch (*cc)
+   DBG(" CSI: '%c' %i args", cc, _csi_arg_count(ty));
+   switch (cc)
      {
       case 'm': // color set
-        _handle_esc_csi_color_set(ty, &b);
+        _handle_esc_csi_color_set(ty);
         break;
       case '@': // insert N blank chars
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("insert %d blank chars", arg);
           {
@@ -388,21 +455,21 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'A': // cursor up N
       case 'e': // cursor up N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("cursor up %d", arg);
         ty->state.wrapnext = 0;
         ty->state.cy = MAX(0, ty->state.cy - arg);
         break;
       case 'B': // cursor down N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("cursor down %d", arg);
         ty->state.wrapnext = 0;
         ty->state.cy = MIN(ty->h - 1, ty->state.cy + arg);
         break;
       case 'D': // cursor left N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("cursor left %d", arg);
         ty->state.wrapnext = 0;
@@ -414,7 +481,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'C': // cursor right N
       case 'a': // cursor right N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("cursor right %d", arg);
         ty->state.wrapnext = 0;
@@ -428,33 +495,20 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
       case 'f': // cursor pos set
         DBG("cursor pos set");
         ty->state.wrapnext = 0;
-        if (!*b)
-          {
-             ty->state.cx = 0;
-             ty->state.cy = 0;
-          }
-        else
-          {
-             arg = _csi_arg_get(&b);
-             if (arg < 1) arg = 1;
-             arg--;
-             if (arg >= ty->h) arg = ty->h - 1;
-             if (b)
-               {
-                  ty->state.cy = arg;
-                  arg = _csi_arg_get(&b);
-                  if (arg < 1) arg = 1;
-                  arg--;
-               }
-             else arg = 0;
-
-             if (arg >= ty->w) arg = ty->w - 1;
-             if (b) ty->state.cx = arg;
-          }
+        arg = _csi_arg_get(ty, 0);
+        if (arg < 1) arg = 1;
+        arg--;
+        if (arg >= ty->h) arg = ty->h - 1;
+        ty->state.cy = arg;
+        arg = _csi_arg_get(ty, 1);
+        if (arg < 1) arg = 1;
+        arg--;
+        if (arg >= ty->w) arg = ty->w - 1;
+        ty->state.cx = arg;
         ty->state.cy += ty->state.margin_top;
        break;
       case 'G': // to column N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("to column %d", arg);
         ty->state.wrapnext = 0;
@@ -463,7 +517,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         else if (ty->state.cx >= ty->w) ty->state.cx = ty->w - 1;
         break;
       case 'd': // to row N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("to row %d", arg);
         ty->state.wrapnext = 0;
@@ -472,7 +526,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         else if (ty->state.cy >= ty->h) ty->state.cy = ty->h - 1;
         break;
       case 'E': // down relative N rows, and to col 0
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("down relative %d rows, and to col 0", arg);
         ty->state.wrapnext = 0;
@@ -482,7 +536,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         ty->state.cx = 0;
         break;
       case 'F': // up relative N rows, and to col 0
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("up relative %d rows, and to col 0", arg);
         ty->state.wrapnext = 0;
@@ -492,28 +546,28 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         ty->state.cx = 0;
         break;
       case 'X': // erase N chars
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("erase %d chars", arg);
         _termpty_clear_line(ty, TERMPTY_CLR_END, arg);
         break;
       case 'S': // scroll up N lines
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("scroll up %d lines", arg);
-        for (i = 0; i < arg; i++) _termpty_text_scroll(ty, EINA_TRUE);
+        _termpty_text_scroll_n(ty, arg, EINA_TRUE);
         break;
       case 'T': // scroll down N lines
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("scroll down %d lines", arg);
-        for (i = 0; i < arg; i++) _termpty_text_scroll_rev(ty, EINA_TRUE);
+        _termpty_text_scroll_rev_n(ty, arg, EINA_TRUE);
         break;
       case 'M': // delete N lines - cy
       case 'L': // insert N lines - cy
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
-        DBG("%s %d lines", (*cc == 'M') ? "delete" : "insert", arg);
+        DBG("%s %d lines", (cc == 'M') ? "delete" : "insert", arg);
           {
              int sy1, sy2;
 
@@ -532,7 +586,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                }
              for (i = 0; i < arg; i++)
                {
-                  if (*cc == 'M') _termpty_text_scroll(ty, EINA_TRUE);
+                  if (cc == 'M') _termpty_text_scroll(ty, EINA_TRUE);
                   else _termpty_text_scroll_rev(ty, EINA_TRUE);
                }
              ty->state.scroll_y1 = sy1;
@@ -540,7 +594,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
           }
         break;
       case 'P': // erase and scrollback N chars
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
         if (arg < 1) arg = 1;
         DBG("erase and scrollback %d chars", arg);
           {
@@ -548,23 +602,21 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
              int x, lim;
 
              cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
+             termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
              lim = ty->w - arg;
-             for (x = ty->state.cx; x < (ty->w); x++)
+             if (ty->state.cx < lim)
+               termpty_cell_copy(ty, &(cells[ty->state.cx + arg]),
+                                 &(cells[ty->state.cx]), lim - ty->state.cx);
+             for (x = MAX(ty->state.cx, lim); x < (ty->w); x++)
                {
-                  if (x < lim)
-                    termpty_cell_copy(ty, &(cells[x + arg]), &(cells[x]), 1);
-                  else
-                    {
-                       cells[x].codepoint = ' ';
-                       cells[x].att.underline = 0;
-                       cells[x].att.blink = 0;
-                       cells[x].att.blink2 = 0;
-                       cells[x].att.inverse = 0;
-                       cells[x].att.strike = 0;
+                  cells[x].codepoint = ' ';
+                  cells[x].att.underline = 0;
+                  cells[x].att.blink = 0;
+                  cells[x].att.inverse = 0;
+                  cells[x].att.strike = 0;
 #if defined(SUPPORT_DBLWIDTH)
-                       cells[x].att.dblwidth = 0;
+                  cells[x].att.dblwidth = 0;
 #endif
-                    }
                }
           }
         break;
@@ -572,7 +624,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         DBG("query device attributes");
           {
              char bf[32];
-             if (b && *b == '>')
+             if (ty->parser.leader == '>')
                {
                   // Primary device attributes
                   //  0 → VT100
@@ -597,46 +649,36 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'J': // "2j" erases the screen, 1j erase from screen start to curs, 0j erase cursor to end of screen
         DBG("2j erases the screen, 1j erase from screen start to curs, 0j erase cursor to end of screen");
-        arg = _csi_arg_get(&b);
-        if (b)
-          {
-             if ((arg >= TERMPTY_CLR_END) && (arg <= TERMPTY_CLR_ALL))
-               _termpty_clear_screen(ty, arg);
-             else
-               ERR("invalid clr scr %i", arg);
-          }
-        else _termpty_clear_screen(ty, TERMPTY_CLR_END);
+        arg = _csi_arg_get(ty, 0);
+        if (arg < 0) arg = TERMPTY_CLR_END;
+        if ((arg >= TERMPTY_CLR_END) && (arg <= TERMPTY_CLR_ALL))
+          _termpty_clear_screen(ty, arg);
+        else
+          ERR("invalid clr scr %i", arg);
         break;
       case 'K': // 0K erase to end of line, 1K erase from screen start to cursor, 2K erase all of line
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, 0);
+        if (arg < 0) arg = TERMPTY_CLR_END;
         DBG("0K erase to end of line, 1K erase from screen start to cursor, 2K erase all of line: %d", arg);
-        if (b)
-          {
-             if ((arg >= TERMPTY_CLR_END) && (arg <= TERMPTY_CLR_ALL))
-               _termpty_clear_line(ty, arg, ty->w);
-             else
-               ERR("invalid clr lin %i", arg);
-          }
-        else _termpty_clear_line(ty, TERMPTY_CLR_END, ty->w);
+        if ((arg >= TERMPTY_CLR_END) && (arg <= TERMPTY_CLR_ALL))
+          _termpty_clear_line(ty, arg, ty->w);
+        else
+          ERR("invalid clr lin %i", arg);
         break;
       case 'h': // list - set screen mode or line wrap ("7h" == turn on line wrap, "7l" disables line wrap , ...)
       case 'l':
           {
              int mode = 0, priv = 0;
-             int handled = 0;
+             int handled = 0, n = _csi_arg_count(ty);
 
-             if (*cc == 'h') mode = 1;
-             if (*b == '?')
-               {
-                  priv = 1;
-                  b++;
-               }
+             if (cc == 'h') mode = 1;
+             if (ty->parser.leader == '?') priv = 1;
              if (priv) /* DEC Private Mode Reset (DECRST) */
                {
-                  while (b)
+                  for (i = 0; i < n; i++)
                     {
-                       arg = _csi_arg_get(&b);
-                       if (b)
+                       arg = _csi_arg_get(ty, i);
+                       if (arg >= 0)
                          {
                             // complete-ish list here:
                             // http://ttssh2.sourceforge.jp/manual/en/about/ctrlseq.html
@@ -876,10 +918,10 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                }
              else /* Reset Mode (RM) */
                {
-                  while (b)
+                  for (i = 0; i < n; i++)
                     {
-                       arg = _csi_arg_get(&b);
-                       if (b)
+                       arg = _csi_arg_get(ty, i);
+                       if (arg >= 0)
                          {
                             switch (arg)
                               {
@@ -916,42 +958,29 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
           }
         break;
       case 'r':
-        arg = _csi_arg_get(&b);
-        if (!b)
-          {
-             WRN("no region args reset region");
-             ty->state.scroll_y1 = 0;
-             ty->state.scroll_y2 = 0;
-          }
-        else
           {
              int arg2;
 
-             arg2 = _csi_arg_get(&b);
-             if (!b)
+             // missing args default to the full screen
+             arg = _csi_arg_get(ty, 0);
+             if (arg < 1) arg = 1;
+             arg2 = _csi_arg_get(ty, 1);
+             if (arg2 < 1) arg2 = ty->h;
+             if (arg > arg2)
                {
-                  WRN("failed to give 2 regions args reset region");
+                  DBG("scroll region beginning > end [%i %i]", arg, arg2);
                   ty->state.scroll_y1 = 0;
                   ty->state.scroll_y2 = 0;
                }
              else
                {
-                  if (arg > arg2)
-                    {
-                       DBG("scroll region beginning > end [%i %i]", arg, arg2);
-                       ty->state.scroll_y1 = 0;
-                       ty->state.scroll_y2 = 0;
-                    }
-                  else
-                    {
-                       DBG("2 regions args: %i %i", arg, arg2);
-                       if (arg >= ty->h) arg = ty->h - 1;
-                       if (arg2 > ty->h) arg2 = ty->h;
-                       ty->state.scroll_y1 = arg - 1;
-                       ty->state.scroll_y2 = arg2;
-                       if ((arg == 1) && (arg2 == ty->h))
-                          ty->state.scroll_y2 = 0;
-                    }
+                  DBG("2 regions args: %i %i", arg, arg2);
+                  if (arg >= ty->h) arg = ty->h - 1;
+                  if (arg2 > ty->h) arg2 = ty->h;
+                  ty->state.scroll_y1 = arg - 1;
+                  ty->state.scroll_y2 = arg2;
+                  if ((arg == 1) && (arg2 == ty->h))
+                     ty->state.scroll_y2 = 0;
                }
           }
         break;
@@ -962,7 +991,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         _termpty_cursor_copy(&(ty->save), &(ty->state));
         break;
       case 'p': // define key assignments based on keycode
-        if (b && *b == '!')
+        if (ty->parser.inter == '!')
           {
              DBG("soft reset (DECSTR)");
              _termpty_reset_state(ty);
@@ -996,7 +1025,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
        {
           int idx, size, cx = ty->state.cx, cy = ty->state.cy;
 
-          arg = _csi_arg_get(&b);
+          arg = _csi_arg_get(ty, 0);
           if (arg < 1) arg = 1;
 
           size = ty->w * cy + cx + 1;
@@ -1021,61 +1050,26 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
       default:
        goto unhandled;
      }
-   cc++;
-   return cc - c;
+   return;
 unhandled:
-     {
-        Eina_Strbuf *bf = eina_strbuf_new();
-
-        for (i = 0; c + i <= cc && i < 100; i++)
-          {
-             if ((c[i] < ' ') || (c[i] >= 0x7f))
-               eina_strbuf_append_printf(bf, "\033[35m%08x\033[0m", c[i]);
-             else
-               eina_strbuf_append_char(bf, c[i]);
-          }
-        ERR("unhandled CSI '%c': %s", *cc, eina_strbuf_string_get(bf));
-        eina_strbuf_free(bf);
-     }
-   cc++;
-   return cc - c;
+   ERR("unhandled CSI '%c' (leader '%c', %i args)", cc,
+       ty->parser.leader ? ty->parser.leader : ' ', _csi_arg_count(ty));
 }
 
-static int
-_handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
+static void
+_handle_esc_xterm(Termpty *ty, const Eina_Unicode *buf, int blen)
 {
-   const Eina_Unicode *cc, *be;
-   Eina_Unicode buf[4096], *b;
+   const Eina_Unicode *txt;
    char *s;
    int len = 0;
 
-   cc = c;
-   b = buf;
-   be = buf + sizeof(buf) / sizeof(buf[0]);
-   while ((cc < ce) && (*cc != ST) && (*cc != BEL) && (b < be))
-     {
-        if ((cc < ce - 1) && (*cc == ESC) && (*(cc + 1) == '\\'))
-          {
-             cc++;
-             break;
-          }
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if (b == be)
-     {
-        ERR("xterm parsing overflowed, skipping the whole buffer (binary data?)");
-        return cc - c;
-     }
-   *b = 0;
-   if ((*cc == ST) || (*cc == BEL) || (*cc == '\\')) cc++;
-   else return 0;
+   // the text follows "N;" - buf is 0 terminated so this may be empty
+   txt = (blen > 2) ? (buf + 2) : (buf + blen);
    switch (buf[0])
      {
       case '0':
         // XXX: title + name - callback
-        s = eina_unicode_unicode_to_utf8(&(buf[2]), &len);
+        s = eina_unicode_unicode_to_utf8(txt, &len);
         if (ty->prop.title) eina_stringshare_del(ty->prop.title);
         if (ty->prop.icon) eina_stringshare_del(ty->prop.icon);
         if (s)
@@ -1094,7 +1088,7 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case '1':
         // XXX: icon name - callback
-        s = eina_unicode_unicode_to_utf8(&(buf[2]), &len);
+        s = eina_unicode_unicode_to_utf8(txt, &len);
         if (ty->prop.icon) eina_stringshare_del(ty->prop.icon);
         if (s)
           {
@@ -1109,7 +1103,7 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case '2':
         // XXX: title - callback
-        s = eina_unicode_unicode_to_utf8(&(buf[2]), &len);
+        s = eina_unicode_unicode_to_utf8(txt, &len);
         if (ty->prop.title) eina_stringshare_del(ty->prop.title);
         if (s)
           {
@@ -1125,49 +1119,20 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
       case '4':
         // XXX: set palette entry. not supported.
         DBG("set palette, not supported");
-        if ((cc - c) < 3) return 0;
-        b = &(buf[2]);
         break;
       default:
         // many others
         ERR("unhandled xterm esc '%c'", buf[0]);
         break;
      }
-    return cc - c;
 }
 
-static int
-_handle_esc_terminology(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+static void
+_handle_esc_terminology(Termpty *ty, Eina_Unicode *buf)
 {
-   Eina_Unicode *cc;
-   Eina_Unicode *buf, bufsmall[1024], *b;
    char *s;
-   int blen = 0, slen =  0;
+   int slen = 0;
 
-   cc = (Eina_Unicode *)c;
-   while ((cc < ce) && (*cc != 0x0))
-     {
-        blen++;
-        cc++;
-     }
-   buf = bufsmall;
-   if (blen > (int)((sizeof(bufsmall) / sizeof(Eina_Unicode)) - 40))
-     buf = malloc((blen * sizeof(Eina_Unicode)) + 40);
-   cc = (Eina_Unicode *)c;
-   b = buf;
-   while ((cc < ce) && (*cc != 0x0))
-     {
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if ((cc < ce) && (*cc == 0x0)) cc++;
-   else
-     {
-        if (buf != bufsmall) free(buf);
-        return 0;
-     }
-   *b = 0;
    // commands are stored in the buffer, 0 bytes not allowd (end marker)
    s = eina_unicode_unicode_to_utf8(buf, &slen);
    ty->cur_cmd = s;
@@ -1177,45 +1142,15 @@ _handle_esc_terminology(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *
      }
    ty->cur_cmd = NULL;
    free(s);
-   if (buf != bufsmall) free(buf);
-   return cc - c;
 }
 
-static int
-_handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unicode *ce)
+static void
+_handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *buf, int len)
 {
-   const Eina_Unicode *cc, *be;
-   Eina_Unicode buf[4096], *b;
-   int len = 0;
-
-   cc = c;
-   b = buf;
-   be = buf + sizeof(buf) / sizeof(buf[0]);
-   while ((cc < ce) && (*cc != ST) && (b < be))
-     {
-        if ((cc < ce - 1) && (*cc == ESC) && (*(cc + 1) == '\\'))
-          {
-             cc++;
-             break;
-          }
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if (b == be)
-     {
-        ERR("dcs parsing overflowed, skipping the whole buffer (binary data?)");
-        len = cc - c;
-        goto end;
-     }
-   *b = 0;
-   if ((*cc == ST) || (*cc == '\\')) cc++;
-   else return 0;
-   len = cc - c;
    switch (buf[0])
      {
       case '+':
-         if (len < 4)
+         if (len < 2)
            goto end;
          switch (buf[1])
            {
@@ -1279,95 +1214,99 @@ _handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unico
         break;
      }
 end:
-   return len;
+   return;
 }
 
-static int
-_handle_esc(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
+static void
+_handle_esc(Termpty *ty, Eina_Unicode c)
 {
-   int len = ce - c;
-
-   if (len < 1) return 0;
-   DBG("ESC: '%c'", c[0]);
-   switch (c[0])
+   DBG("ESC: '%c'", c);
+   switch (c)
      {
-      case '[':
-        len = _handle_esc_csi(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
-      case ']':
-        len = _handle_esc_xterm(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
-      case '}':
-        len = _handle_esc_terminology(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
-      case 'P':
-        len =  _handle_esc_dcs(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
       case '=': // set alternate keypad mode
         ty->state.alt_kp = 1;
-        return 1;
+        return;
       case '>': // set numeric keypad mode
         ty->state.alt_kp = 0;
-        return 1;
+        return;
       case 'M': // move to prev line
         ty->state.wrapnext = 0;
         ty->state.cy--;
         _termpty_text_scroll_rev_test(ty, EINA_TRUE);
-        return 1;
+        return;
       case 'D': // move to next line
         ty->state.wrapnext = 0;
         ty->state.cy++;
         _termpty_text_scroll_test(ty, EINA_FALSE);
-        return 1;
+        return;
       case 'E': // add \n\r
         ty->state.wrapnext = 0;
         ty->state.cx = 0;
         ty->state.cy++;
         _termpty_text_scroll_test(ty, EINA_FALSE);
-        return 1;
+        return;
       case 'Z': // same a 'ESC [ Pn c'
         _term_txt_write(ty, "\033[?1;2C");
-        return 1;
+        return;
       case 'c': // reset terminal to initial state
         DBG("reset to init mode and clear");
         _termpty_reset_state(ty);
         _termpty_clear_screen(ty, TERMPTY_CLR_ALL);
         if (ty->cb.cancel_sel.func)
           ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
-        return 1;
+        return;
+      case '7': // save cursor pos
+        _termpty_cursor_copy(&(ty->state), &(ty->save));
+        return;
+      case '8': // restore cursor pos
+        _termpty_cursor_copy(&(ty->save), &(ty->state));
+        return;
+/*
+      case 'G': // query gfx mode
+        return;
+      case 'H': // set tab at current column
+        return;
+      case 'n': // single shift 2
+        return;
+      case 'o': // single shift 3
+        return;
+ */
+      default:
+        ERR("eek - esc unhandled '%c' (0x%02x)", c, c);
+        return;
+     }
+}
+
+/* escapes that take one more char: ESC <inter> <c> */
+static void
+_handle_esc_charset(Termpty *ty, Eina_Unicode inter, Eina_Unicode c)
+{
+   DBG("ESC: '%c%c'", inter, c);
+   switch (inter)
+     {
       case '(': // charset 0
-        if (len < 2) return 0;
-        ty->state.chset[0] = c[1];
+        ty->state.chset[0] = c;
         ty->state.multibyte = 0;
-        ty->state.charsetch = c[1];
-        return 2;
+        ty->state.charsetch = c;
+        return;
       case ')': // charset 1
-        if (len < 2) return 0;
-        ty->state.chset[1] = c[1];
+        ty->state.chset[1] = c;
         ty->state.multibyte = 0;
-        return 2;
+        return;
       case '*': // charset 2
-        if (len < 2) return 0;
-        ty->state.chset[2] = c[1];
+        ty->state.chset[2] = c;
         ty->state.multibyte = 0;
-        return 2;
+        return;
       case '+': // charset 3
-        if (len < 2) return 0;
-        ty->state.chset[3] = c[1];
+        ty->state.chset[3] = c;
         ty->state.multibyte = 0;
-        return 2;
+        return;
       case '$': // charset -2
-        if (len < 2) return 0;
-        ty->state.chset[2] = c[1];
+        ty->state.chset[2] = c;
         ty->state.multibyte = 1;
-        return 2;
+        return;
       case '#': // #8 == test mode -> fill screen with "E";
-        if (len < 2) return 0;
-        if (c[1] == '8')
+        if (c == '8')
           {
              int size;
              Termcell *cells;
@@ -1389,207 +1328,386 @@ _handle_esc(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                   termpty_cell_codepoint_att_fill(ty, 'E', att, cells, size);
                }
           }
-        return 2;
+        return;
       case '@': // just consume this plus next char
-        if (len < 2) return 0;
-        return 2;
-      case '7': // save cursor pos
-        _termpty_cursor_copy(&(ty->state), &(ty->save));
-        return 1;
-      case '8': // restore cursor pos
-        _termpty_cursor_copy(&(ty->save), &(ty->state));
-        return 1;
-/*
-      case 'G': // query gfx mode
-        return 2;
-      case 'H': // set tab at current column
-        return 1;
-      case 'n': // single shift 2
-        return 1;
-      case 'o': // single shift 3
-        return 1;
- */
       default:
-        ERR("eek - esc unhandled '%c' (0x%02x)", c[0], c[0]);
-        return 1;
+        return;
      }
-   return 0;
 }
 
-int
-_termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce)
+static void
+_handle_control(Termpty *ty, Eina_Unicode c)
 {
-   Eina_Unicode *cc;
-   int len = 0;
-
-/*   
-   printf(" B: ");
-   int j;
-   for (j = 0; c + j < ce && j < 100; j++)
+   switch (c)
      {
-        if ((c[j] < ' ') || (c[j] >= 0x7f))
-          printf("\033[35m%08x\033[0m", c[j]);
-        else
-          printf("%c", c[j]);
-     }
-   printf("\n");
- */
-   if (c[0] < 0x20)
-     {
-        switch (c[0])
-          {
 /*
-           case 0x00: // NUL
-             return 1;
-           case 0x01: // SOH (start of heading)
-             return 1;
-           case 0x02: // STX (start of text)
-             return 1;
-           case 0x03: // ETX (end of text)
-             return 1;
-           case 0x04: // EOT (end of transmission)
-             return 1;
+      case 0x00: // NUL
+        return;
+      case 0x01: // SOH (start of heading)
+        return;
+      case 0x02: // STX (start of text)
+        return;
+      case 0x03: // ETX (end of text)
+        return;
+      case 0x04: // EOT (end of transmission)
+        return;
  */
 /*
-           case 0x05: // ENQ (enquiry)
-             _term_txt_write(ty, "ABC\r\n");
-             ty->state.had_cr = 0;
-             return 1;
+      case 0x05: // ENQ (enquiry)
+        _term_txt_write(ty, "ABC\r\n");
+        ty->state.had_cr = 0;
+        return;
  */
 /*
-           case 0x06: // ACK (acknowledge)
-             return 1;
+      case 0x06: // ACK (acknowledge)
+        return;
  */
-           case 0x07: // BEL '\a' (bell)
-           case 0x08: // BS  '\b' (backspace)
-           case 0x09: // HT  '\t' (horizontal tab)
-           case 0x0a: // LF  '\n' (new line)
-           case 0x0b: // VT  '\v' (vertical tab)
-           case 0x0c: // FF  '\f' (form feed)
-           case 0x0d: // CR  '\r' (carriage ret)
-             _handle_cursor_control(ty, c);
-             return 1;
+      case 0x07: // BEL '\a' (bell)
+      case 0x08: // BS  '\b' (backspace)
+      case 0x09: // HT  '\t' (horizontal tab)
+      case 0x0a: // LF  '\n' (new line)
+      case 0x0b: // VT  '\v' (vertical tab)
+      case 0x0c: // FF  '\f' (form feed)
+      case 0x0d: // CR  '\r' (carriage ret)
+        _handle_cursor_control(ty, c);
+        return;
 
-           case 0x0e: // SO  (shift out) // Maps G1 character set into GL.
-             ty->state.had_cr = 0;
-             ty->state.charset = 1;
-             ty->state.charsetch = ty->state.chset[1];
-             return 1;
-           case 0x0f: // SI  (shift in) // Maps G0 character set into GL.
-             ty->state.charset = 0;
-             ty->state.had_cr = 0;
-             ty->state.charsetch = ty->state.chset[0];
-             return 1;
+      case 0x0e: // SO  (shift out) // Maps G1 character set into GL.
+        ty->state.had_cr = 0;
+        ty->state.charset = 1;
+        ty->state.charsetch = ty->state.chset[1];
+        return;
+      case 0x0f: // SI  (shift in) // Maps G0 character set into GL.
+        ty->state.charset = 0;
+        ty->state.had_cr = 0;
+        ty->state.charsetch = ty->state.chset[0];
+        return;
 /*
-           case 0x10: // DLE (data link escape)
-             return 1;
-           case 0x11: // DC1 (device control 1)
-             return 1;
-           case 0x12: // DC2 (device control 2)
-             return 1;
-           case 0x13: // DC3 (device control 3)
-             return 1;
-           case 0x14: // DC4 (device control 4)
-             return 1;
-           case 0x15: // NAK (negative ack.)
-             return 1;
-           case 0x16: // SYN (synchronous idle)
-             return 1;
-           case 0x17: // ETB (end of trans. blk)
-             return 1;
-           case 0x18: // CAN (cancel)
-             return 1;
-           case 0x19: // EM  (end of medium)
-             return 1;
-           case 0x1a: // SUB (substitute)
-             return 1;
+      case 0x10: // DLE (data link escape)
+        return;
+      case 0x11: // DC1 (device control 1)
+        return;
+      case 0x12: // DC2 (device control 2)
+        return;
+      case 0x13: // DC3 (device control 3)
+        return;
+      case 0x14: // DC4 (device control 4)
+        return;
+      case 0x15: // NAK (negative ack.)
+        return;
+      case 0x16: // SYN (synchronous idle)
+        return;
+      case 0x17: // ETB (end of trans. blk)
+        return;
+      case 0x18: // CAN (cancel)
+        return;
+      case 0x19: // EM  (end of medium)
+        return;
+      case 0x1a: // SUB (substitute)
+        return;
  */
-           case 0x1b: // ESC (escape)
-             ty->state.had_cr = 0;
-             len = _handle_esc(ty, c + 1, ce);
-             if (len == 0) return 0;
-             return 1 + len;
 /*
-           case 0x1c: // FS  (file separator)
-             return 1;
-           case 0x1d: // GS  (group separator)
-             return 1;
-           case 0x1e: // RS  (record separator)
-             return 1;
-           case 0x1f: // US  (unit separator)
-             return 1;
+      case 0x1c: // FS  (file separator)
+        return;
+      case 0x1d: // GS  (group separator)
+        return;
+      case 0x1e: // RS  (record separator)
+        return;
+      case 0x1f: // US  (unit separator)
+        return;
  */
-           default:
+      default:
+        ty->state.had_cr = 0;
+        //ERR("unhandled char 0x%02x", c);
+        return;
+     }
+}
+
+static void
+_handle_block_char(Termpty *ty, Eina_Unicode c)
+{
+   Termexp *ex;
+   Eina_List *l;
+
+   EINA_LIST_FOREACH(ty->block.expecting, l, ex)
+     {
+        if (c == ex->ch)
+          {
+             Eina_Unicode cp;
+
+             cp = (1 << 31) | ((ex->id & 0x1fff) << 18) |
+               ((ex->x & 0x1ff) << 9) | (ex->y & 0x1ff);
+             ex->x++;
+             if (ex->x >= ex->w)
+               {
+                  ex->x = 0;
+                  ex->y++;
+               }
+             ex->left--;
+             _termpty_text_append(ty, &cp, 1);
+             if (ex->left <= 0)
+               {
+                  ty->block.expecting =
+                    eina_list_remove_list(ty->block.expecting, l);
+                  free(ex);
+               }
+             else
+               ty->block.expecting =
+               eina_list_promote_list(ty->block.expecting, l);
+             return;
+          }
+     }
+   _termpty_text_append(ty, &c, 1);
+}
+
+static void
+_str_append(Termpty *ty, const Eina_Unicode *c, int len)
+{
+   Termparser *p = &(ty->parser);
+   Eina_Unicode *b;
+   int size;
+
+   if (p->str.skip) return;
+   if ((p->str.state != TERMPTY_PARSE_TERMINOLOGY) &&
+       ((p->str.len + len) > STRING_MAX))
+     {
+        ERR("%s parsing overflowed, skipping it (binary data?)",
+            (p->str.state == TERMPTY_PARSE_OSC) ? "xterm" : "dcs");
+        p->str.skip = 1;
+        return;
+     }
+   // always leave room for the terminating 0
+   if ((p->str.len + len + 1) > p->str.size)
+     {
+        size = p->str.size ? p->str.size : 256;
+        while ((p->str.len + len + 1) > size) size *= 2;
+        b = realloc(p->str.buf, size * sizeof(Eina_Unicode));
+        if (!b)
+          {
+             ERR("memerr");
+             p->str.skip = 1;
+             return;
+          }
+        p->str.buf = b;
+        p->str.size = size;
+     }
+   if (len > 0)
+     memcpy(p->str.buf + p->str.len, c, len * sizeof(Eina_Unicode));
+   p->str.len += len;
+}
+
+static void
+_str_dispatch(Termpty *ty)
+{
+   Termparser *p = &(ty->parser);
+
+   _str_append(ty, NULL, 0);
+   if (p->str.skip) return;
+   p->str.buf[p->str.len] = 0;
+   switch (p->str.state)
+     {
+      case TERMPTY_PARSE_OSC:
+        _handle_esc_xterm(ty, p->str.buf, p->str.len);
+        break;
+      case TERMPTY_PARSE_DCS:
+        _handle_esc_dcs(ty, p->str.buf, p->str.len);
+        break;
+      case TERMPTY_PARSE_TERMINOLOGY:
+        _handle_esc_terminology(ty, p->str.buf);
+        break;
+      default:
+        break;
+     }
+   // don't hang on to the odd huge command
+   if (p->str.size > (4 * STRING_MAX))
+     {
+        free(p->str.buf);
+        p->str.buf = NULL;
+        p->str.size = 0;
+     }
+}
+
+static const Eina_Unicode *
+_parse_ground(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+{
+   const Eina_Unicode *cc;
+
+   if (*c < 0x20)
+     {
+        if (*c == ESC)
+          {
              ty->state.had_cr = 0;
-             //ERR("unhandled char 0x%02x", c[0]);
-             return 1;
+             ty->parser.state = TERMPTY_PARSE_ESCAPE;
           }
+        else
+          _handle_control(ty, *c);
+        return c + 1;
      }
-   else if (c[0] == 0x7f) // DEL
+   else if (*c == 0x7f) // DEL
      {
         ty->state.had_cr = 0;
-        ERR("unhandled char 0x%02x [DEL]", c[0]);
-        return 1;
+        ERR("unhandled char 0x%02x [DEL]", *c);
+        return c + 1;
      }
-   else if (c[0] == 0x9b) // ANSI ESC!!!
+   else if (*c == CSI) // ANSI ESC!!!
      {
         ty->state.had_cr = 0;
         DBG("ANSI CSI!!!!!");
-        len = _handle_esc_csi(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
+        ty->parser.argc = 0;
+        ty->parser.args[0] = -1;
+        ty->parser.leader = 0;
+        ty->parser.inter = 0;
+        ty->parser.state = TERMPTY_PARSE_CSI_ENTRY;
+        return c + 1;
      }
    else if ((ty->block.expecting) && (ty->block.on))
      {
-        Termexp *ex;
-        Eina_List *l;
-        
         ty->state.had_cr = 0;
-        EINA_LIST_FOREACH(ty->block.expecting, l, ex)
+        _handle_block_char(ty, *c);
+        return c + 1;
+     }
+   for (cc = c; (cc < ce) && (*cc >= 0x20) && (*cc != 0x7f) && (*cc != CSI);
+        cc++);
+   _termpty_text_append(ty, c, cc - c);
+   ty->state.had_cr = 0;
+   return cc;
+}
+
+static const Eina_Unicode *
+_parse_string(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+{
+   static const Eina_Unicode esc = ESC;
+   Termparser *p = &(ty->parser);
+   const Eina_Unicode *cc = c;
+
+   if (p->state == TERMPTY_PARSE_STRING_ESC)
+     {
+        p->state = p->str.state;
+        if (*c == '\\')
           {
-             if (c[0] == ex->ch)
-               {
-                  Eina_Unicode cp;
-             
-                  cp = (1 << 31) | ((ex->id & 0x1fff) << 18) |
-                    ((ex->x & 0x1ff) << 9) | (ex->y & 0x1ff);
-                  ex->x++;
-                  if (ex->x >= ex->w)
-                    {
-                       ex->x = 0;
-                       ex->y++;
-                    }
-                  ex->left--;
-                  _termpty_text_append(ty, &cp, 1);
-                  if (ex->left <= 0)
-                    {
-                       ty->block.expecting = 
-                         eina_list_remove_list(ty->block.expecting, l);
-                       free(ex);
-                    }
-                  else
-                    ty->block.expecting =
-                    eina_list_promote_list(ty->block.expecting, l);
-                  return 1;
-               }
+             _str_dispatch(ty);
+             p->state = TERMPTY_PARSE_GROUND;
+             return c + 1;
           }
-        _termpty_text_append(ty, c, 1);
-        return 1;
+        // not a terminator - the ESC belongs to the string
+        _str_append(ty, &esc, 1);
+        return c;
+     }
+   // commands are stored in the buffer, 0 bytes not allowd (end marker)
+   if (p->state == TERMPTY_PARSE_TERMINOLOGY)
+     {
+        while ((cc < ce) && (*cc != 0)) cc++;
      }
    else
      {
-        ty->state.had_cr = 0;
+        while ((cc < ce) && (*cc != ESC) && (*cc != ST) &&
+               ((*cc != BEL) || (p->state != TERMPTY_PARSE_OSC)))
+          cc++;
+     }
+   _str_append(ty, c, cc - c);
+   if (cc == ce) return cc;
+   if (*cc == ESC)
+     p->state = TERMPTY_PARSE_STRING_ESC;
+   else
+     {
+        _str_dispatch(ty);
+        p->state = TERMPTY_PARSE_GROUND;
+     }
+   return cc + 1;
+}
+
+static const Eina_Unicode *
+_parse_escape(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+{
+   Termparser *p = &(ty->parser);
+   Eina_Unicode g;
+   unsigned char t;
+   int v;
+
+   for (; c < ce; c++)
+     {
+        g = *c;
+        t = _transitions[p->state - TABLE_FIRST][MIN(g, TABLE_HIGH)];
+        switch (t >> 4)
+          {
+           case ACT_EXECUTE:
+             _handle_control(ty, g);
+             break;
+           case ACT_COLLECT:
+             p->inter = g;
+             break;
+           case ACT_LEADER:
+             p->leader = g;
+             break;
+           case ACT_PARAM:
+             v = p->args[p->argc];
+             if (v < 0) v = 0;
+             v = (v * 10) + (g - '0');
+             if (v > 0xffff) v = 0xffff;
+             p->args[p->argc] = v;
+             break;
+           case ACT_PARAM_NEXT:
+             // past the last arg everything lands in a spare slot
+             if (p->argc < TERMPTY_PARSER_ARGS_MAX) p->argc++;
+             p->args[p->argc] = -1;
+             break;
+           case ACT_ESC_DISPATCH:
+             if (p->state == TERMPTY_PARSE_ESCAPE_CHARSET)
+               _handle_esc_charset(ty, p->inter, g);
+             else
+               _handle_esc(ty, g);
+             break;
+           case ACT_CSI_START:
+             p->argc = 0;
+             p->args[0] = -1;
+             p->leader = 0;
+             p->inter = 0;
+             break;
+           case ACT_CSI_DISPATCH:
+             _handle_esc_csi(ty, g);
+             break;
+           case ACT_STR_START:
+             p->str.len = 0;
+             p->str.skip = 0;
+             p->str.state = t & 0x0f;
+             break;
+           default:
+             break;
+          }
+        p->state = t & 0x0f;
+        if (p->state < TABLE_FIRST) return c + 1;
      }
-   cc = (int *)c;
-   DBG("txt: [");
-   while ((cc < ce) && (*cc >= 0x20) && (*cc != 0x7f))
+   return c;
+}
+
+void
+_termpty_parse(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+{
+   while (c < ce)
      {
-        DBG("%c", *cc);
-        cc++;
-        len++;
+        switch (ty->parser.state)
+          {
+           case TERMPTY_PARSE_GROUND:
+             c = _parse_ground(ty, c, ce);
+             break;
+           case TERMPTY_PARSE_OSC:
+           case TERMPTY_PARSE_DCS:
+           case TERMPTY_PARSE_TERMINOLOGY:
+           case TERMPTY_PARSE_STRING_ESC:
+             c = _parse_string(ty, c, ce);
+             break;
+           default:
+             c = _parse_escape(ty, c, ce);
+             break;
+          }
      }
-   DBG("]");
-   _termpty_text_append(ty, c, len);
+}
+
+/* printable ascii straight from the read buffer - no escape can start in
+ * such a run, so it goes to the screen as it is */
+void
+_termpty_handle_ascii(Termpty *ty, const char *c, int len)
+{
    ty->state.had_cr = 0;
-   return len;
+   _termpty_text_append_ascii(ty, c, len);
 }
@@ -1,6 +1,7 @@
 #ifndef _TERMPTY_ESC_H__
 #define _TERMPTY_ESC_H__ 1
 
-int _termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce);
+void _termpty_parse(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce);
+void _termpty_handle_ascii(Termpty *ty, const char *c, int len);
 
 #endif
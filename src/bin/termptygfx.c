@@ -62,3 +62,11 @@ _termpty_charset_trans(Eina_Unicode g, Termstate *state)
      }
    return g;
 }
+
+/* true if _termpty_charset_trans() would return every codepoint as is */
+Eina_Bool
+_termpty_charset_trans_none(const Termstate *state)
+{
+   return ((state->charsetch != '0') && (state->charsetch != 'A') &&
+           (!state->att.fraktur));
+}
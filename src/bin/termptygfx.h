@@ -4,5 +4,6 @@
 #include "termpty.h"
 
 Eina_Unicode _termpty_charset_trans(Eina_Unicode g, Termstate *state);
+Eina_Bool _termpty_charset_trans_none(const Termstate *state);
 
 #endif
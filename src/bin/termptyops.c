@@ -43,15 +43,12 @@ termpty_text_save_top(Termpty *ty, Termcell *cells, ssize_t w_max)
    ts = termpty_save_new(w);
    termpty_cell_copy(ty, cells, ts->cell, w);
    if (!ty->back) ty->back = calloc(1, sizeof(Termsave *) * ty->backmax);
-   if (ty->back[ty->backpos])
-     {
-        Termsave *ts2;
-        
-        ts2 = termpty_save_extract(ty->back[ty->backpos]);
-        termpty_save_free(ts2);
-        ty->back[ty->backpos] = NULL;
-     }
+   // once back[] is full the lines still to be reflowed can't go back in
+   if ((ty->reflow.num) && (ty->backscroll_num >= ty->backmax))
+     termpty_reflow_drop(ty);
+   termpty_save_drop(ty, ty->backpos);
    ty->back[ty->backpos] = ts;
+   termpty_save_dirty(ty, ty->backpos);
    ty->backpos++;
    if (ty->backpos >= ty->backmax) ty->backpos = 0;
    ty->backscroll_num++;
@@ -59,89 +56,169 @@ termpty_text_save_top(Termpty *ty, Termcell *cells, ssize_t w_max)
    termpty_save_thaw();
 }
 
+/* rows y1..y2 can be moved with a single memmove if the circular buffer
+ * doesn't wrap between them and no inline media cell needs refcounting */
+static Eina_Bool
+_rows_memmovable(Termpty *ty, int y1, int y2)
+{
+   if (termpty_block_any(ty)) return EINA_FALSE;
+   if ((y1 < 0) || (y2 >= ty->h)) return EINA_FALSE;
+   return &(TERMPTY_SCREEN(ty, 0, y1)) <= &(TERMPTY_SCREEN(ty, 0, y2));
+}
+
 void
-_termpty_text_scroll(Termpty *ty, Eina_Bool clear)
+_termpty_text_scroll_n(Termpty *ty, int n, Eina_Bool clear)
 {
-   Termcell *cells = NULL, *cells2;
-   int y, start_y = 0, end_y = ty->h - 1;
+   int y, start_y = 0, end_y = ty->h - 1, rows;
 
    if (ty->state.scroll_y2 != 0)
      {
         start_y = ty->state.scroll_y1;
         end_y = ty->state.scroll_y2 - 1;
      }
-   else
-     if (!ty->altbuf)
-       termpty_text_save_top(ty, &(TERMPTY_SCREEN(ty, 0, 0)), ty->w);
+   if (n < 1) return;
+   rows = end_y - start_y + 1;
+   if (rows < 1)
+     {
+        // nothing to move, but the last line still gets cleared
+        termio_scroll(ty->obj, -n, start_y, end_y);
+        if (clear)
+          {
+             _text_clear(ty, &(TERMPTY_SCREEN(ty, 0, end_y)), ty->w, 0, EINA_TRUE);
+             termpty_dirty_rows(ty, end_y, end_y);
+          }
+        return;
+     }
+   // a region past the screen bottom wraps around onto itself, it only
+   // makes sense one line at a time
+   if ((end_y >= ty->h) && (n > 1))
+     {
+        for (; n > 0; n--) _termpty_text_scroll_n(ty, 1, clear);
+        return;
+     }
+   // scrolling more than the region is scrolling it whole a few times
+   for (; n > rows; n -= rows)
+     _termpty_text_scroll_n(ty, rows, clear);
+
+   if ((ty->state.scroll_y2 == 0) && (!ty->altbuf))
+     {
+        termpty_save_freeze();
+        for (y = 0; y < n; y++)
+          termpty_text_save_top(ty, &(TERMPTY_SCREEN(ty, 0, y)), ty->w);
+        termpty_save_thaw();
+     }
 
-   termio_scroll(ty->obj, -1, start_y, end_y);
-   DBG("... scroll!!!!! [%i->%i]", start_y, end_y);
+   termio_scroll(ty->obj, -n, start_y, end_y);
+   DBG("... scroll %i!!!!! [%i->%i]", n, start_y, end_y);
+   termpty_dirty_scroll(ty, start_y, end_y, n);
 
    if (start_y == 0 && end_y == ty->h - 1)
      {
        // screen is a circular buffer now
-       cells = &(ty->screen[ty->circular_offset * ty->w]);
        if (clear)
-          _text_clear(ty, cells, ty->w, 0, EINA_TRUE);
-
-       ty->circular_offset++;
-       if (ty->circular_offset >= ty->h)
-         ty->circular_offset = 0;
+         {
+            for (y = 0; y < n; y++)
+              _text_clear(ty, &(TERMPTY_SCREEN(ty, 0, y)), ty->w, 0, EINA_TRUE);
+         }
+       ty->circular_offset = (ty->circular_offset + n) % ty->h;
      }
    else
      {
-       cells = &(TERMPTY_SCREEN(ty, 0, end_y));
-       for (y = start_y; y < end_y; y++)
+       if (_rows_memmovable(ty, start_y, end_y))
+         memmove(&(TERMPTY_SCREEN(ty, 0, start_y)),
+                 &(TERMPTY_SCREEN(ty, 0, start_y + n)),
+                 sizeof(Termcell) * ty->w * (rows - n));
+       else
          {
-            cells = &(TERMPTY_SCREEN(ty, 0, (y + 1)));
-            cells2 = &(TERMPTY_SCREEN(ty, 0, y));
-            termpty_cell_copy(ty, cells, cells2, ty->w);
+            for (y = start_y; y + n <= end_y; y++)
+              termpty_cell_copy(ty, &(TERMPTY_SCREEN(ty, 0, y + n)),
+                                &(TERMPTY_SCREEN(ty, 0, y)), ty->w);
          }
        if (clear)
-          _text_clear(ty, cells, ty->w, 0, EINA_TRUE);
+         {
+            for (y = end_y - n + 1; y <= end_y; y++)
+              _text_clear(ty, &(TERMPTY_SCREEN(ty, 0, y)), ty->w, 0, EINA_TRUE);
+         }
      }
 }
 
 void
-_termpty_text_scroll_rev(Termpty *ty, Eina_Bool clear)
+_termpty_text_scroll(Termpty *ty, Eina_Bool clear)
+{
+   _termpty_text_scroll_n(ty, 1, clear);
+}
+
+void
+_termpty_text_scroll_rev_n(Termpty *ty, int n, Eina_Bool clear)
 {
-   Termcell *cells, *cells2 = NULL;
-   int y, start_y = 0, end_y = ty->h - 1;
+   int y, start_y = 0, end_y = ty->h - 1, rows;
 
    if (ty->state.scroll_y2 != 0)
      {
         start_y = ty->state.scroll_y1;
         end_y = ty->state.scroll_y2 - 1;
      }
-   DBG("... scroll rev!!!!! [%i->%i]", start_y, end_y);
-   termio_scroll(ty->obj, 1, start_y, end_y);
+   if (n < 1) return;
+   rows = end_y - start_y + 1;
+   // see _termpty_text_scroll_n()
+   if (rows < 1)
+     {
+        termio_scroll(ty->obj, n, start_y, end_y);
+        if (clear)
+          {
+             _text_clear(ty, &(TERMPTY_SCREEN(ty, 0, end_y)), ty->w, 0, EINA_TRUE);
+             termpty_dirty_rows(ty, end_y, end_y);
+          }
+        return;
+     }
+   if ((end_y >= ty->h) && (n > 1))
+     {
+        for (; n > 0; n--) _termpty_text_scroll_rev_n(ty, 1, clear);
+        return;
+     }
+   for (; n > rows; n -= rows)
+     _termpty_text_scroll_rev_n(ty, rows, clear);
+
+   DBG("... scroll rev %i!!!!! [%i->%i]", n, start_y, end_y);
+   termio_scroll(ty->obj, n, start_y, end_y);
+   termpty_dirty_scroll(ty, start_y, end_y, -n);
 
    if (start_y == 0 && end_y == ty->h - 1)
      {
        // screen is a circular buffer now
-       ty->circular_offset--;
-       if (ty->circular_offset < 0)
-         ty->circular_offset = ty->h - 1;
-
-       cells = &(ty->screen[ty->circular_offset * ty->w]);
+       ty->circular_offset = (ty->circular_offset + ty->h - n) % ty->h;
        if (clear)
-          _text_clear(ty, cells, ty->w, 0, EINA_TRUE);
+         {
+            for (y = 0; y < n; y++)
+              _text_clear(ty, &(TERMPTY_SCREEN(ty, 0, y)), ty->w, 0, EINA_TRUE);
+         }
      }
    else
      {
-       cells = &(TERMPTY_SCREEN(ty, 0, end_y));
-       for (y = end_y; y > start_y; y--)
+       if (_rows_memmovable(ty, start_y, end_y))
+         memmove(&(TERMPTY_SCREEN(ty, 0, start_y + n)),
+                 &(TERMPTY_SCREEN(ty, 0, start_y)),
+                 sizeof(Termcell) * ty->w * (rows - n));
+       else
          {
-            cells = &(TERMPTY_SCREEN(ty, 0, (y - 1)));
-            cells2 = &(TERMPTY_SCREEN(ty, 0, y));
-            termpty_cell_copy(ty, cells, cells2, ty->w);
+            for (y = end_y; y - n >= start_y; y--)
+              termpty_cell_copy(ty, &(TERMPTY_SCREEN(ty, 0, y - n)),
+                                &(TERMPTY_SCREEN(ty, 0, y)), ty->w);
          }
-       y = start_y;
        if (clear)
-          _text_clear(ty, cells, ty->w, 0, EINA_TRUE);
+         {
+            for (y = start_y; y < start_y + n; y++)
+              _text_clear(ty, &(TERMPTY_SCREEN(ty, 0, y)), ty->w, 0, EINA_TRUE);
+         }
      }
 }
 
+void
+_termpty_text_scroll_rev(Termpty *ty, Eina_Bool clear)
+{
+   _termpty_text_scroll_rev_n(ty, 1, clear);
+}
+
 void
 _termpty_text_scroll_test(Termpty *ty, Eina_Bool clear)
 {
@@ -168,13 +245,15 @@ _termpty_text_scroll_rev_test(Termpty *ty, Eina_Bool clear)
      }
 }
 
-void
-_termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
+/* one codepoint at a time, for everything the run path below can't do:
+ * insert mode, charset translation, wide chars and block placeholders.
+ * returns EINA_FALSE if the rest of the text is to be dropped */
+static inline Eina_Bool
+_text_append_cells(Termpty *ty, const Eina_Unicode *codepoints,
+                   const char *ascii, int len)
 {
    Termcell *cells;
-   int i, j;
-
-   termio_content_change(ty->obj, ty->state.cx, ty->state.cy, len);
+   int i;
 
    cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
    for (i = 0; i < len; i++)
@@ -188,15 +267,18 @@ _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
              ty->state.cx = 0;
              ty->state.cy++;
              _termpty_text_scroll_test(ty, EINA_TRUE);
+             termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
              cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
           }
-        if (ty->state.insert)
-          {
-             for (j = ty->w - 1; j > ty->state.cx; j--)
-               termpty_cell_copy(ty, &(cells[j - 1]), &(cells[j]), 1);
-          }
+        if ((ty->state.insert) && (ty->state.cx < (ty->w - 1)))
+          termpty_cell_copy(ty, &(cells[ty->state.cx]),
+                            &(cells[ty->state.cx + 1]),
+                            ty->w - 1 - ty->state.cx);
 
-        g = _termpty_charset_trans(codepoints[i], &ty->state);
+        if (ascii)
+          g = _termpty_charset_trans((unsigned char)ascii[i], &ty->state);
+        else
+          g = _termpty_charset_trans(codepoints[i], &ty->state);
 
         termpty_cell_codepoint_att_fill(ty, g, ty->state.att,
                                         &(cells[ty->state.cx]), 1);
@@ -234,10 +316,128 @@ _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
              if (ty->state.cx > (ty->w - offset))
                {
                   ty->state.cx = ty->w - offset;
-                  return;
+                  return EINA_FALSE;
+               }
+          }
+     }
+   return EINA_TRUE;
+}
+
+/* plain narrow text overwriting plain cells: fill whole row segments at
+ * once and only wrap and scroll per row. same results as the loop above */
+static inline Eina_Bool
+_text_append_run(Termpty *ty, const Eina_Unicode *codepoints,
+                 const char *ascii, int len)
+{
+   Termcell local, *cells;
+   int i, n;
+
+   memset(&local, 0, sizeof(local));
+   local.att = ty->state.att;
+#if defined(SUPPORT_DBLWIDTH)
+   local.att.dblwidth = 0;
+#endif
+   while (len > 0)
+     {
+        if (ty->state.wrapnext)
+          {
+             cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
+             cells[ty->w - 1].att.autowrapped = 1;
+             ty->state.wrapnext = 0;
+             ty->state.cx = 0;
+             ty->state.cy++;
+             _termpty_text_scroll_test(ty, EINA_TRUE);
+             termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
+          }
+        cells = &(TERMPTY_SCREEN(ty, ty->state.cx, ty->state.cy));
+        n = MIN(len, ty->w - ty->state.cx);
+        if (ascii)
+          {
+             for (i = 0; i < n; i++)
+               {
+                  local.codepoint = (unsigned char)ascii[i];
+                  cells[i] = local;
+               }
+             ascii += n;
+          }
+        else
+          {
+             for (i = 0; i < n; i++)
+               {
+                  local.codepoint = codepoints[i];
+                  cells[i] = local;
                }
+             codepoints += n;
           }
+        len -= n;
+        ty->state.cx += n;
+        if (ty->state.cx < ty->w) continue;
+        ty->state.cx = ty->w - 1;
+        if (!ty->state.wrap) return EINA_FALSE;
+        ty->state.wrapnext = 1;
      }
+   return EINA_TRUE;
+}
+
+/* shared by the codepoint and the ascii entry points - exactly one of
+ * codepoints and ascii is set, so each caller gets its own copy of the loop
+ * with the other branch folded away */
+static inline void
+_text_append(Termpty *ty, const Eina_Unicode *codepoints, const char *ascii,
+             int len)
+{
+   Eina_Unicode limit;
+   int i = 0, n;
+
+   termio_content_change(ty->obj, ty->state.cx, ty->state.cy, len);
+   termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
+
+   // below 0x300 nothing combines and nothing is wide, unless ambiguous
+   // width chars are - inline media placeholders need refcounting
+   if ((ty->state.insert) || (ty->state.cx >= ty->w) ||
+       (!_termpty_charset_trans_none(&ty->state)) ||
+       (termpty_block_any(ty)))
+     {
+        _text_append_cells(ty, codepoints, ascii, len);
+        return;
+     }
+   limit = ty->state.cjk_ambiguous_wide ? 0xa1 : 0x300;
+   while (i < len)
+     {
+        if (ascii) n = len - i;
+        else
+          {
+             for (n = i; (n < len) && (codepoints[n] < limit); n++);
+             n -= i;
+          }
+        if (n > 0)
+          {
+             if (!_text_append_run(ty, codepoints ? codepoints + i : NULL,
+                                   ascii ? ascii + i : NULL, n))
+               return;
+             i += n;
+          }
+        for (n = i; (n < len) && (codepoints[n] >= limit); n++);
+        n -= i;
+        if (n > 0)
+          {
+             if (!_text_append_cells(ty, codepoints + i, NULL, n))
+               return;
+             i += n;
+          }
+     }
+}
+
+void
+_termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
+{
+   _text_append(ty, codepoints, NULL, len);
+}
+
+void
+_termpty_text_append_ascii(Termpty *ty, const char *txt, int len)
+{
+   _text_append(ty, NULL, txt, len);
 }
 
 void
@@ -265,6 +465,7 @@ _termpty_clear_line(Termpty *ty, Termpty_Clear mode, int limit)
    cells = &(TERMPTY_SCREEN(ty, x, y));
    if (n > limit) n = limit;
    termio_content_change(ty->obj, x, y, n);
+   termpty_dirty_rows(ty, y, y);
    _text_clear(ty, cells, n, 0, EINA_TRUE);
 }
 
@@ -282,6 +483,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
              int l = ty->h - (ty->state.cy + 1);
 
              termio_content_change(ty->obj, 0, ty->state.cy, l * ty->w);
+             termpty_dirty_rows(ty, ty->state.cy + 1, ty->h - 1);
 
              while (l)
                {
@@ -298,6 +500,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
              int y = ty->state.cy + ty->circular_offset;
 
              termio_content_change(ty->obj, 0, 0, ty->state.cy * ty->w);
+             termpty_dirty_rows(ty, 0, ty->state.cy - 1);
 
              cells = &(TERMPTY_SCREEN(ty, 0, 0));
 
@@ -318,6 +521,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
         break;
       case TERMPTY_CLR_ALL:
         ty->circular_offset = 0;
+        termpty_dirty_all(ty);
         _text_clear(ty, ty->screen, ty->w * ty->h, 0, EINA_TRUE);
         ty->state.scroll_y2 = 0;
         if (ty->cb.cancel_sel.func)
@@ -332,6 +536,7 @@ void
 _termpty_clear_all(Termpty *ty)
 {
    if (!ty->screen) return;
+   termpty_dirty_all(ty);
    termpty_cell_fill(ty, NULL, ty->screen, ty->w * ty->h);
 }
 
@@ -349,7 +554,6 @@ _termpty_reset_att(Termatt *att)
 #endif
    att->underline = 0;
    att->blink = 0;
-   att->blink2 = 0;
    att->inverse = 0;
    att->invisible = 0;
    att->strike = 0;
@@ -11,10 +11,13 @@ typedef enum _Termpty_Clear
 void termpty_text_save_top(Termpty *ty, Termcell *cells, ssize_t w_max);
 void _termpty_text_copy(Termpty *ty, Termcell *cells, Termcell *dest, int count);
 void _termpty_text_scroll(Termpty *ty, Eina_Bool clear);
+void _termpty_text_scroll_n(Termpty *ty, int n, Eina_Bool clear);
 void _termpty_text_scroll_rev(Termpty *ty, Eina_Bool clear);
+void _termpty_text_scroll_rev_n(Termpty *ty, int n, Eina_Bool clear);
 void _termpty_text_scroll_test(Termpty *ty, Eina_Bool clear);
 void _termpty_text_scroll_rev_test(Termpty *ty, Eina_Bool clear);
 void _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len);
+void _termpty_text_append_ascii(Termpty *ty, const char *txt, int len);
 void _termpty_clear_line(Termpty *ty, Termpty_Clear mode, int limit);
 void _termpty_clear_screen(Termpty *ty, Termpty_Clear mode);
 void _termpty_clear_all(Termpty *ty);
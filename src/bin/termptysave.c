@@ -2,8 +2,12 @@
 #include <Elementary.h>
 #include "termpty.h"
 #include "termptysave.h"
+#include "termio.h"
 #include "lz4/lz4.h"
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #if defined (__MacOSX__) || (defined (__MACH__) && defined (__APPLE__))
 # ifndef MAP_ANONYMOUS
@@ -11,168 +15,280 @@
 # endif
 #endif
 
-#define MEM_PAGE_SIZE    4096
+// rows come from blocks of MEM_BLOCK_SIZE aligned on their size, so the
+// block of any row is found by masking its address. a block serves one size
+// class and recycles freed rows through a free list. rows too big for any
+// class get a block of their own
+#define MEM_BLOCK_SIZE   (128 * 1024)
 #define MEM_ALLOC_ALIGN  16
-#define MEM_BLOCK_PAGES  32
-#define MEM_BLOCKS       1024
+#define MEM_CLASSES      (64 + 48 + 56)
+#define MEM_CLASS_MAX    32768
+#define MEM_LARGE        -1
 
 typedef struct _Alloc Alloc;
 
 struct _Alloc
 {
-   int size, last, count;
-   short slot;
-   unsigned char gen;
-   unsigned char __pad;
+   Alloc *prev, *next; // blocks of the class with room left, or draining
+   void *free; // freed rows, linked through their first word
+   int size; // of the mapping
+   int last; // first never used byte
+   int count; // rows in use
+   int cls; // size class or MEM_LARGE
+   Eina_Bool drain; // being emptied by _mem_compact()
 };
 
-static unsigned char cur_gen = 0;
-static Alloc *alloc[MEM_BLOCKS] =  { 0 };
+#define MEM_HEADER \
+   (MEM_ALLOC_ALIGN * ((sizeof(Alloc) + MEM_ALLOC_ALIGN - 1) / MEM_ALLOC_ALIGN))
+#define MEM_BLOCK(ptr) \
+   ((Alloc *)((size_t)(ptr) & ~((size_t)MEM_BLOCK_SIZE - 1)))
 
-static void *
-_alloc_new(int size, unsigned char gen)
+static Alloc *partial[MEM_CLASSES] = { 0 };
+static Alloc *draining = NULL;
+static size_t mem_mapped = 0, mem_used = 0;
+// rows freed while the compressor thread may read them, see _mem_free()
+static void *limbo = NULL;
+static int alloc_pin = 0;
+
+static int
+_alloc_class(int size)
 {
-   Alloc *al;
-   unsigned char *ptr;
-   int newsize, sz, i, firstnull = -1;
+   if (size <= 1024) return (size - 1) / 16;
+   if (size <= 4096) return 64 + ((size - 1025) / 64);
+   return 64 + 48 + ((size - 4097) / 512);
+}
 
-   // allocations sized up to nearest size alloc alignment
-   newsize = MEM_ALLOC_ALIGN * ((size + MEM_ALLOC_ALIGN - 1) / MEM_ALLOC_ALIGN);
-   for (i = 0; i < MEM_BLOCKS; i++)
-     {
-        if (!alloc[i])
-          {
-             if (firstnull < 0) firstnull = i;
-             continue;
-          }
-        // if generation count matches
-        if (alloc[i]->gen == gen)
-          {
-             // if there is space in the block
-             if ((alloc[i]->size - alloc[i]->last) >= newsize)
-               {
-                  ptr = (unsigned char *)alloc[i];
-                  ptr += alloc[i]->last;
-                  alloc[i]->last += newsize;
-                  alloc[i]->count++;
-                  return ptr;
-               }
-          }
-     }
-   // out of slots for new blocks - no null blocks
-   if (firstnull < 0) return NULL;
+static int
+_alloc_class_size(int cls)
+{
+   if (cls < 64) return (cls + 1) * 16;
+   if (cls < 64 + 48) return 1024 + ((cls - 64 + 1) * 64);
+   return 4096 + ((cls - 64 - 48 + 1) * 512);
+}
+
+static Alloc *
+_alloc_block_new(int size)
+{
+   unsigned char *ptr, *al;
+   size_t sz, lead;
 
-   // so allocate a new block
-   size = MEM_BLOCK_PAGES * MEM_PAGE_SIZE;
-   // size up to page size
-   sz = MEM_PAGE_SIZE * ((size + MEM_PAGE_SIZE - 1) / MEM_PAGE_SIZE);
+   // size up to the block size and map a block more, to align it
+   sz = MEM_BLOCK_SIZE * ((size + MEM_BLOCK_SIZE - 1) / MEM_BLOCK_SIZE);
    // get mmaped anonymous memory so when freed it goes away from the system
-   ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+   ptr = mmap(NULL, sz + MEM_BLOCK_SIZE, PROT_READ | PROT_WRITE,
               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
    if (ptr == MAP_FAILED) return NULL;
+   al = (unsigned char *)MEM_BLOCK(ptr + MEM_BLOCK_SIZE - 1);
+   lead = al - ptr;
+   if (lead > 0) munmap(ptr, lead);
+   if (MEM_BLOCK_SIZE - lead > 0)
+     munmap(al + sz, MEM_BLOCK_SIZE - lead);
 
-   // note - we SHOULD memset to 0, but we are assuming mmap anon give 0 pages
-   //memset(ptr, 0, newsize);
-
-   al = (Alloc *)ptr;
-   al->size = sz;
-   al->last = sizeof(Alloc) + newsize;
-   al->count = 1;
-   al->slot = firstnull;
-   al->gen = gen;
-   alloc[al->slot] = al;
-   ptr = (unsigned char *)al;
-   ptr += sizeof(Alloc);
-   return ptr;
+   // note - mmap anon gives 0 pages so the header is all 0 already
+   mem_mapped += sz;
+   ((Alloc *)al)->size = sz;
+   ((Alloc *)al)->last = MEM_HEADER;
+   return (Alloc *)al;
 }
 
 static void
-_alloc_free(Alloc *al)
+_alloc_block_free(Alloc *al)
 {
-   al->count--;
-   if (al->count > 0) return;
-   alloc[al->slot] = NULL;
+   mem_mapped -= al->size;
    munmap(al, al->size);
 }
 
-static Alloc *
-_alloc_find(void *mem)
+static void
+_alloc_unlink(Alloc *al)
 {
-   unsigned char *memptr = mem;
-   int i;
-   
-   for (i = 0; i < MEM_BLOCKS; i++)
+   Alloc **list = al->drain ? &draining : &(partial[al->cls]);
+
+   if (al->prev) al->prev->next = al->next;
+   else *list = al->next;
+   if (al->next) al->next->prev = al->prev;
+   al->prev = al->next = NULL;
+}
+
+static void
+_alloc_link(Alloc *al)
+{
+   Alloc **list = al->drain ? &draining : &(partial[al->cls]);
+
+   al->prev = NULL;
+   al->next = *list;
+   if (al->next) al->next->prev = al;
+   *list = al;
+}
+
+static Eina_Bool
+_alloc_full(Alloc *al, int size)
+{
+   return ((!al->free) && ((al->size - al->last) < size));
+}
+
+static void *
+_alloc_new(int size)
+{
+   Alloc *al;
+   unsigned char *ptr;
+   int cls;
+
+   if (size > MEM_CLASS_MAX)
      {
-        unsigned char *ptr;
-        
-        ptr = (unsigned char *)alloc[i];
-        if (!ptr) continue;
-        if (memptr < ptr) continue;
-        if ((memptr - ptr) > 0x0fffffff) continue;
-        if (((size_t)memptr - (size_t)ptr) < (size_t)(alloc[i]->size))
-          return alloc[i];
+        al = _alloc_block_new(MEM_HEADER + size);
+        if (!al) return NULL;
+        al->cls = MEM_LARGE;
+        al->count = 1;
+        mem_used += al->size - MEM_HEADER;
+        return ((unsigned char *)al) + MEM_HEADER;
      }
-   return NULL;
+   cls = _alloc_class(size);
+   size = _alloc_class_size(cls);
+   al = partial[cls];
+   if (!al)
+     {
+        al = _alloc_block_new(MEM_BLOCK_SIZE);
+        if (!al) return NULL;
+        al->cls = cls;
+        _alloc_link(al);
+     }
+   if (al->free)
+     {
+        ptr = al->free;
+        al->free = *((void **)ptr);
+        // rows rely on a zeroed header, as fresh mmaped pages give
+        memset(ptr, 0, MEM_ALLOC_ALIGN);
+     }
+   else
+     {
+        ptr = ((unsigned char *)al) + al->last;
+        al->last += size;
+     }
+   al->count++;
+   mem_used += size;
+   if (_alloc_full(al, size)) _alloc_unlink(al);
+   return ptr;
+}
+
+static void
+_alloc_free(void *ptr)
+{
+   Alloc *al = MEM_BLOCK(ptr);
+   int size;
+
+   if (al->cls == MEM_LARGE)
+     {
+        mem_used -= al->size - MEM_HEADER;
+        _alloc_block_free(al);
+        return;
+     }
+   size = _alloc_class_size(al->cls);
+   mem_used -= size;
+   // a draining block is never full, it only loses rows
+   if (_alloc_full(al, size)) _alloc_link(al);
+   al->count--;
+   if (al->count <= 0)
+     {
+        _alloc_unlink(al);
+        _alloc_block_free(al);
+        return;
+     }
+   *((void **)ptr) = al->free;
+   al->free = ptr;
 }
 
 static void *
 _mem_new(int size)
 {
-   void *ptr;
-   
    if (!size) return NULL;
-   ptr = _alloc_new(size, cur_gen);
-   return ptr;
+   return _alloc_new(size);
 }
 
 static void
 _mem_free(void *ptr)
 {
-   Alloc *al;
-   
    if (!ptr) return;
-   al = _alloc_find(ptr);
-   if (!al)
+   // the compressor thread may still be reading rows freed now, they must
+   // neither be reused nor unmapped until it is done and _mem_unpin() runs
+   if (alloc_pin)
      {
-        ERR("Cannot find %p in alloc blocks", ptr);
+        *((void **)ptr) = limbo;
+        limbo = ptr;
         return;
      }
-   _alloc_free(al);
+   _alloc_free(ptr);
 }
 
 static void
-_mem_defrag(void)
+_mem_pin(void)
 {
-   int i, j = 0;
-   Alloc *alloc2[MEM_BLOCKS];
-   
-   for (i = 0; i < MEM_BLOCKS; i++)
-     {
-        if (alloc[i])
-          {
-//             printf("block %i @ %i [%i/%i] # %i\n", 
-//                    j, alloc[i]->gen, alloc[i]->last, alloc[i]->size, alloc[i]->count);
-             alloc2[j] = alloc[i];
-             alloc2[j]->slot = j;
-             j++;
-          }
-     }
-   // XXX: quicksort blocks with most space at start
-   for (i = 0; i < j; i++) alloc[i] = alloc2[i];
-   for (; i < MEM_BLOCKS; i++) alloc[i] = NULL;
+   alloc_pin++;
 }
 
 static void
-_mem_gen_next(void)
+_mem_unpin(void)
 {
-   cur_gen++;
+   alloc_pin--;
+   if (alloc_pin > 0) return;
+   while (limbo)
+     {
+        void *ptr = limbo;
+
+        limbo = *((void **)ptr);
+        _alloc_free(ptr);
+     }
 }
 
-static unsigned char
-_mem_gen_get(void)
+#define COMP_BATCH 4096
+// runs of consecutive rows compressed together into one chunk
+#define CHUNK_ROWS_MIN 64
+#define CHUNK_ROWS_MAX 256
+#define CHUNK_CACHE 4
+// rows read without being taken out of their compressed copy
+#define ROW_CACHE 256
+
+typedef struct _Comp_Job Comp_Job;
+typedef struct _Comp_Batch Comp_Batch;
+typedef struct _Chunk_Cache Chunk_Cache;
+typedef struct _Row_Cache Row_Cache;
+
+struct _Termsavechunk
 {
-   return cur_gen;
-}
+   int refs; // Termsaverefs still pointing here
+   int rows, cells, bytes; // bytes of LZ4 data after the offsets
+   int off[1]; // rows + 1 offsets of each row in cells
+};
+
+struct _Chunk_Cache
+{
+   Termsavechunk *chunk;
+   Termcell *cells;
+   int size;
+};
+
+struct _Row_Cache
+{
+   Row_Cache *prev, *next;
+   Termsave *ts; // the compressed row, NULL if the entry is free
+   Termcell *cells;
+   int size;
+};
+
+struct _Comp_Job
+{
+   Termpty *ty;
+   Termsave *ts; // the row as it was in ty->back[slot] when queued
+   char *buf; // compressed cells, filled in by the thread
+   Termsavechunk *chunk; // or the chunk of a run starting at this job
+   int slot, w, bytes;
+   int rows; // length of the run of consecutive slots starting here
+};
+
+struct _Comp_Batch
+{
+   int num;
+   Comp_Job job[COMP_BATCH];
+};
 
 static int ts_comp = 0;
 static int ts_uncomp = 0;
@@ -182,110 +298,639 @@ static int freeze = 0;
 static Eina_List *ptys = NULL;
 static Ecore_Idler *idler = NULL;
 static Ecore_Timer *timer = NULL;
+static Ecore_Thread *comp_thread = NULL;
+static Comp_Batch *comp_done = NULL;
+static Eina_Bool comp_more = EINA_FALSE;
+static double comp_budget = 0.004;
+static Eina_Bool comp_chunks = EINA_FALSE;
+static size_t mem_rows = 0; // bytes held by the rows of all ptys
+static size_t mem_budget = 0; // 0 for no limit
+// decompressed chunks, most recently used first
+static Chunk_Cache chunk_cache[CHUNK_CACHE];
+// decompressed rows, most recently used first and free entries last
+static Row_Cache row_cache[ROW_CACHE];
+static Row_Cache *row_first = NULL, *row_last = NULL;
+static Eina_Hash *row_hash = NULL;
+
+static inline void _check_compressor(Eina_Bool frozen);
+
+#define CHUNK_DATA(ch) ((char *)(&((ch)->off[(ch)->rows + 1])))
+
+static Termsavechunk *
+_chunk_new(Comp_Job *j, int rows)
+{
+   Termsavechunk *ch, *ch2;
+   Termcell *src;
+   int i, size, cells = 0;
+
+   for (i = 0; i < rows; i++) cells += j[i].w;
+   size = cells * sizeof(Termcell);
+   src = malloc(size + sizeof(Termcell));
+   if (!src) return NULL;
+   ch = malloc(sizeof(Termsavechunk) + (rows * sizeof(int)) +
+               LZ4_compressBound(size));
+   if (!ch)
+     {
+        free(src);
+        return NULL;
+     }
+   ch->refs = 0;
+   ch->rows = rows;
+   ch->cells = cells;
+   for (cells = 0, i = 0; i < rows; i++)
+     {
+        ch->off[i] = cells;
+        memcpy(src + cells, &(j[i].ts->cell[0]), j[i].w * sizeof(Termcell));
+        cells += j[i].w;
+     }
+   ch->off[rows] = cells;
+   ch->bytes = LZ4_compress((char *)src, CHUNK_DATA(ch), size);
+   free(src);
+   if (ch->bytes <= 0)
+     {
+        free(ch);
+        return NULL;
+     }
+   ch2 = realloc(ch, sizeof(Termsavechunk) + (rows * sizeof(int)) +
+                 ch->bytes);
+   return ch2 ? ch2 : ch;
+}
+
+static void
+_chunk_unref(Termsavechunk *ch)
+{
+   int i;
+
+   ch->refs--;
+   if (ch->refs > 0) return;
+   for (i = 0; i < CHUNK_CACHE; i++)
+     {
+        if (chunk_cache[i].chunk == ch) chunk_cache[i].chunk = NULL;
+     }
+   free(ch);
+}
+
+static const Termcell *
+_chunk_cells(Termsavechunk *ch)
+{
+   Chunk_Cache c;
+   int i;
+
+   for (i = 0; i < CHUNK_CACHE - 1; i++)
+     {
+        if (chunk_cache[i].chunk == ch) break;
+     }
+   c = chunk_cache[i];
+   memmove(chunk_cache + 1, chunk_cache, i * sizeof(Chunk_Cache));
+   chunk_cache[0] = c;
+   if (c.chunk == ch) return c.cells;
+
+   // not cached - reuse the least recently used entry
+   if (c.size < ch->cells)
+     {
+        Termcell *tmp = realloc(c.cells, ch->cells * sizeof(Termcell));
+
+        if (!tmp) return NULL;
+        c.cells = tmp;
+        c.size = ch->cells;
+     }
+   c.chunk = ch;
+   if ((ch->cells > 0) &&
+       (LZ4_uncompress(CHUNK_DATA(ch), (char *)c.cells,
+                       ch->cells * sizeof(Termcell)) < 0))
+     memset(c.cells, 0, ch->cells * sizeof(Termcell));
+   chunk_cache[0] = c;
+   return c.cells;
+}
+
+static void
+_row_unlink(Row_Cache *rc)
+{
+   if (rc->prev) rc->prev->next = rc->next;
+   else row_first = rc->next;
+   if (rc->next) rc->next->prev = rc->prev;
+   else row_last = rc->prev;
+   rc->prev = rc->next = NULL;
+}
+
+static void
+_row_link(Row_Cache *rc, Eina_Bool first)
+{
+   if (first)
+     {
+        rc->next = row_first;
+        if (row_first) row_first->prev = rc;
+        else row_last = rc;
+        row_first = rc;
+     }
+   else
+     {
+        rc->prev = row_last;
+        if (row_last) row_last->next = rc;
+        else row_first = rc;
+        row_last = rc;
+     }
+}
+
+static void
+_row_forget(Termsave *ts)
+{
+   Row_Cache *rc;
+
+   if (!ts->cached) return;
+   ts->cached = 0;
+   rc = eina_hash_find(row_hash, &ts);
+   if (!rc) return;
+   eina_hash_del_by_key(row_hash, &ts);
+   rc->ts = NULL;
+   _row_unlink(rc);
+   _row_link(rc, EINA_FALSE);
+}
+
+static Termcell *
+_row_cells(Termsave *ts)
+{
+   Termsavecomp *tsc = (Termsavecomp *)ts;
+   Row_Cache *rc = NULL;
+   int i;
+
+   if (!row_hash)
+     {
+        row_hash = eina_hash_pointer_new(NULL);
+        if (!row_hash) return NULL;
+        for (i = 0; i < ROW_CACHE; i++) _row_link(&(row_cache[i]), EINA_FALSE);
+     }
+   if (ts->cached) rc = eina_hash_find(row_hash, &ts);
+   if (!rc)
+     {
+        // not cached - reuse the least recently used entry
+        rc = row_last;
+        if (rc->ts) _row_forget(rc->ts);
+        // empty rows still get cells to point at
+        if ((!rc->cells) || (rc->size < (int)tsc->wout))
+          {
+             int size = tsc->wout ? tsc->wout : 1;
+             Termcell *tmp = realloc(rc->cells, size * sizeof(Termcell));
+
+             if (!tmp) return NULL;
+             rc->cells = tmp;
+             rc->size = size;
+          }
+        if ((tsc->wout > 0) &&
+            LZ4_uncompress(((char *)tsc) + sizeof(Termsavecomp),
+                           (char *)rc->cells,
+                           tsc->wout * sizeof(Termcell)) < 0)
+          memset(rc->cells, 0, tsc->wout * sizeof(Termcell));
+        if (!eina_hash_add(row_hash, &ts, rc)) return NULL;
+        rc->ts = ts;
+        ts->cached = 1;
+     }
+   _row_unlink(rc);
+   _row_link(rc, EINA_TRUE);
+   return rc->cells;
+}
+
+// what a row costs, a row of a chunk taking its share of the chunk
+static size_t
+_row_bytes(const Termsave *ts)
+{
+   Alloc *al = MEM_BLOCK(ts);
+   size_t size;
+
+   if (al->cls == MEM_LARGE) size = al->size - MEM_HEADER;
+   else size = _alloc_class_size(al->cls);
+   if (ts->ref)
+     {
+        const Termsavechunk *ch = ((const Termsaveref *)ts)->chunk;
+
+        size += (sizeof(Termsavechunk) + (ch->rows * sizeof(int)) +
+                 ch->bytes) / ch->rows;
+     }
+   return size;
+}
+
+static void
+_row_account(Termpty *ty, const Termsave *ts, Eina_Bool add)
+{
+   size_t *total, size;
+
+   if (!ts) return;
+   size = _row_bytes(ts);
+   total = ts->z ? &(ty->backmem.comp) : &(ty->backmem.uncomp);
+   if (add)
+     {
+        *total += size;
+        mem_rows += size;
+     }
+   else
+     {
+        *total -= size;
+        mem_rows -= size;
+     }
+}
+
+static Eina_Bool
+_dirty_add(Termpty *ty, int slot)
+{
+   // after a wrap around of back[] the list holds stale and duplicate slots,
+   // the idler rebuilds it rather than let it grow
+   if (ty->backdirty.num >= ty->backmax)
+     {
+        ty->backdirty.rescan = EINA_TRUE;
+        return EINA_TRUE;
+     }
+   if (ty->backdirty.num >= ty->backdirty.size)
+     {
+        int *tmp, size = ty->backdirty.size ? ty->backdirty.size * 2 : 256;
+
+        tmp = realloc(ty->backdirty.slot, size * sizeof(int));
+        if (!tmp) return EINA_FALSE;
+        ty->backdirty.slot = tmp;
+        ty->backdirty.size = size;
+     }
+   ty->backdirty.slot[ty->backdirty.num++] = slot;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_walk_stop(Comp_Batch *b, int n, double t_end)
+{
+   if ((b->num >= COMP_BATCH) ||
+       (((n & 0xff) == 0xff) && (ecore_time_get() > t_end)))
+     {
+        comp_more = EINA_TRUE;
+        return EINA_TRUE;
+     }
+   return EINA_FALSE;
+}
+
+static void
+_walk_slot(Termpty *ty, Comp_Batch *b, int slot, Comp_Job **run, int *prev)
+{
+   Comp_Job *j;
+   Termsave *ts;
+
+   if ((!ty->back) || (slot >= ty->backmax)) return;
+   ts = ty->back[slot];
+   if ((!ts) || (ts->z)) return;
+   j = &(b->job[b->num++]);
+   // the thread reads the cells in place - they are never modified
+   // once saved and _mem_pin() keeps them from being reused
+   j->ty = ty;
+   j->ts = ts;
+   j->slot = slot;
+   j->w = ts->w;
+   if ((comp_chunks) && (*run) && ((*run)->rows < CHUNK_ROWS_MAX) &&
+       (slot == ((*prev + 1) % ty->backmax)))
+     (*run)->rows++;
+   else
+     {
+        *run = j;
+        (*run)->rows = 1;
+     }
+   *prev = slot;
+}
+
+static void
+_walk_pty(Termpty *ty, Comp_Batch *b, double t_end)
+{
+   Comp_Job *run = NULL;
+   int i, n = 0, prev = -1, slot;
+
+   if (ty->backdirty.rescan) termpty_save_rescan(ty);
+   // only the rows saved or extracted since the last pass are looked at,
+   // the newly saved ones first and oldest first so they make long runs
+   while (ty->backdirty.fresh > 0)
+     {
+        if (_walk_stop(b, n++, t_end)) return;
+        slot = (ty->backpos - ty->backdirty.fresh + ty->backmax) %
+          ty->backmax;
+        ty->backdirty.fresh--;
+        _walk_slot(ty, b, slot, &run, &prev);
+     }
+   for (i = 0; i < ty->backdirty.num; i++)
+     {
+        if (_walk_stop(b, n++, t_end)) break;
+        _walk_slot(ty, b, ty->backdirty.slot[i], &run, &prev);
+     }
+   if (i == 0) return;
+   ty->backdirty.num -= i;
+   memmove(ty->backdirty.slot, ty->backdirty.slot + i,
+           ty->backdirty.num * sizeof(int));
+}
+
+// blocks of a size class used less than 1 / MEM_SPARSE get emptied
+#define MEM_SPARSE 4
+
+static size_t
+_mem_compact(void)
+{
+   Eina_List *l;
+   Termpty *ty;
+   Alloc *al, *next;
+   size_t mapped = mem_mapped;
+   int cls, size, i;
+
+   // a walk over all the scrollback is only worth it with half of it slack
+   if ((mem_mapped < (8 * MEM_BLOCK_SIZE)) || (mem_used > (mem_mapped / 2)))
+     return 0;
+   for (cls = 0; cls < MEM_CLASSES; cls++)
+     {
+        Alloc *keep = partial[cls];
+
+        // the fullest block of the class takes in the rows of the others
+        size = _alloc_class_size(cls);
+        for (al = partial[cls]; al; al = al->next)
+          {
+             if (al->count > keep->count) keep = al;
+          }
+        for (al = partial[cls]; al; al = next)
+          {
+             next = al->next;
+             if ((al == keep) ||
+                 ((al->count * size) > ((al->size - MEM_HEADER) / MEM_SPARSE)))
+               continue;
+             // no new rows go to a draining block
+             _alloc_unlink(al);
+             al->drain = EINA_TRUE;
+             _alloc_link(al);
+          }
+     }
+   if (!draining) return 0;
+
+   // the rows are only pointed at from back[] so moving them is easy
+   EINA_LIST_FOREACH(ptys, l, ty)
+     {
+        if (!ty->back) continue;
+        for (i = 0; i < ty->backmax; i++)
+          {
+             Termsave *ts = ty->back[i], *ts2;
+
+             if ((!ts) || (!MEM_BLOCK(ts)->drain)) continue;
+             size = _alloc_class_size(MEM_BLOCK(ts)->cls);
+             ts2 = _mem_new(size);
+             if (!ts2) break;
+             _row_forget(ts);
+             memcpy(ts2, ts, size);
+             _mem_free(ts);
+             ty->back[i] = ts2;
+          }
+     }
+   // blocks still holding rows keep them
+   while (draining)
+     {
+        al = draining;
+        _alloc_unlink(al);
+        al->drain = EINA_FALSE;
+        _alloc_link(al);
+     }
+   DBG("scrollback compaction reclaimed %zu bytes", mapped - mem_mapped);
+   return mapped - mem_mapped;
+}
+
+static void
+_comp_batch_free(Comp_Batch *b)
+{
+   int i;
+
+   for (i = 0; i < b->num; i++)
+     {
+        free(b->job[i].buf);
+        if (b->job[i].chunk) free(b->job[i].chunk);
+     }
+   free(b);
+}
+
+static void
+_comp_thread_run(void *data, Ecore_Thread *thread)
+{
+   Comp_Batch *b = data;
+   int i;
+
+   for (i = 0; i < b->num; i++)
+     {
+        Comp_Job *j = &(b->job[i]);
+        int size = j->w * sizeof(Termcell);
+
+        if (ecore_thread_check(thread)) return;
+        if (j->rows >= CHUNK_ROWS_MIN)
+          {
+             j->chunk = _chunk_new(j, j->rows);
+             // failing that, the rows go one by one
+             if (j->chunk)
+               {
+                  i += j->rows - 1;
+                  continue;
+               }
+          }
+        j->buf = malloc(LZ4_compressBound(size));
+        if (!j->buf) continue;
+        j->bytes = LZ4_compress((char *)(&(j->ts->cell[0])), j->buf, size);
+     }
+}
+
+static Eina_Bool
+_comp_job_valid(Comp_Job *j)
+{
+   Termpty *ty = j->ty;
+
+   // the row may have been freed, extracted or moved meanwhile. as its
+   // memory stayed pinned no new row can share its address
+   return ((ty->back) && (j->slot < ty->backmax) &&
+           (ty->back[j->slot] == j->ts));
+}
 
-static Termsave *
-_save_comp(Termsave *ts)
+static void
+_comp_apply_chunk(Comp_Job *j)
 {
-   Termsave *ts2;
-   Termsavecomp *tsc;
+   Termsavechunk *ch = j->chunk;
+   int i;
+
+   for (i = 0; i < ch->rows; i++)
+     {
+        Termpty *ty = j[i].ty;
+        Termsaveref *tsr;
+
+        if (!_comp_job_valid(&(j[i]))) continue;
+        tsr = _mem_new(sizeof(Termsaveref));
+        if (!tsr)
+          {
+             ERR("Big problem. Can't allocate backscroll chunk row");
+             _dirty_add(ty, j[i].slot);
+             continue;
+          }
+        tsr->comp = 1;
+        tsr->z = 1;
+        tsr->ref = 1;
+        tsr->wrap = termpty_save_wrapped(j[i].ts);
+        tsr->row = i;
+        tsr->chunk = ch;
+        ch->refs++;
+        _row_account(ty, j[i].ts, EINA_FALSE);
+        termpty_save_free(j[i].ts);
+        ty->back[j[i].slot] = (Termsave *)tsr;
+        _row_account(ty, (Termsave *)tsr, EINA_TRUE);
+        ts_uncomp--;
+        ts_comp++;
+     }
+   j->chunk = NULL;
+   if (!ch->refs) free(ch);
+}
+
+static void
+_comp_apply(Comp_Batch *b)
+{
+   Termpty *ty = NULL;
+   Eina_Bool alive = EINA_FALSE;
+   int i;
 
-   // already compacted
-   if (ts->comp) return ts;
-   // make new allocation for new generation
    ts_compfreeze++;
-   if (!ts->z)
+   for (i = 0; i < b->num; i++)
      {
-        int bytes;
-        char *buf;
-        
-        buf = alloca(LZ4_compressBound(ts->w * sizeof(Termcell)));
-        bytes = LZ4_compress((char *)(&(ts->cell[0])), buf,
-                             ts->w * sizeof(Termcell));
-        tsc = _mem_new(sizeof(Termsavecomp) + bytes);
+        Comp_Job *j = &(b->job[i]);
+        Termsavecomp *tsc;
+
+        if (j->ty != ty)
+          {
+             ty = j->ty;
+             alive = !!eina_list_data_find(ptys, ty);
+          }
+        if (!alive) continue;
+        if (j->chunk)
+          {
+             // a run is always within one pty
+             i += j->rows - 1;
+             _comp_apply_chunk(j);
+             continue;
+          }
+        if (!_comp_job_valid(j)) continue;
+        if ((!j->buf) || (j->bytes <= 0))
+          {
+             _dirty_add(ty, j->slot);
+             continue;
+          }
+        tsc = _mem_new(sizeof(Termsavecomp) + j->bytes);
         if (!tsc)
           {
              ERR("Big problem. Can't allocate backscroll compress buffer");
-             ts2 = ts;
-             goto done;
+             _dirty_add(ty, j->slot);
+             continue;
           }
         tsc->comp = 1;
         tsc->z = 1;
-        tsc->gen = _mem_gen_get();
-        tsc->w = bytes;
-        tsc->wout = ts->w;
-        memcpy(((char *)tsc) + sizeof(Termsavecomp), buf, bytes);
-        ts2 = (Termsave *)tsc;
+        tsc->w = j->bytes;
+        tsc->wout = j->w;
+        tsc->wrap = termpty_save_wrapped(j->ts);
+        memcpy(((char *)tsc) + sizeof(Termsavecomp), j->buf, j->bytes);
+        _row_account(ty, j->ts, EINA_FALSE);
+        termpty_save_free(j->ts);
+        ty->back[j->slot] = (Termsave *)tsc;
+        _row_account(ty, (Termsave *)tsc, EINA_TRUE);
+        ts_uncomp--;
+        ts_comp++;
      }
-   else
+   ts_compfreeze--;
+   _comp_batch_free(b);
+   _mem_unpin();
+   ts_freeops = 0;
+}
+
+static void
+_comp_thread_end(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   comp_thread = NULL;
+   // rows must not change under a freeze - apply it on the last thaw
+   if (freeze > 0)
      {
-        ts2 = ts;
-        tsc = (Termsavecomp *)ts;
-        ts2 = _mem_new(sizeof(Termsavecomp) + tsc->w);
-        if (!ts2)
-          {
-             ERR("Big problem. Can't allocate backscroll compress/copy buffer");
-             ts2 = ts;
-             goto done;
-          }
-        memcpy(ts2, ts, sizeof(Termsavecomp) + tsc->w);
-        ts2->gen = _mem_gen_get();
-        ts2->comp = 1;
+        comp_done = data;
+        return;
      }
-   termpty_save_free(ts);
-done:
-   ts_compfreeze--;
-   return ts2;
+   _comp_apply(data);
+   _check_compressor(EINA_FALSE);
 }
 
 static void
-_walk_pty(Termpty *ty)
+_comp_thread_cancel(void *data, Ecore_Thread *thread EINA_UNUSED)
 {
-   int i;
-//   int c0 = 0, c1 = 0;
+   comp_thread = NULL;
+   _comp_batch_free(data);
+   _mem_unpin();
+}
 
-   if (!ty->back) return;
-   for (i = 0; i < ty->backmax; i++)
+// over the memory budget the oldest rows of the biggest pty go first
+static void
+_mem_budget_keep(double t_end)
+{
+   while ((mem_budget) && (mem_rows > mem_budget))
      {
-        Termsavecomp *tsc = (Termsavecomp *)ty->back[i];
+        Termpty *ty, *big = NULL;
+        Eina_List *l;
+        int i;
 
-        if (tsc)
+        EINA_LIST_FOREACH(ptys, l, ty)
+          {
+             if ((ty->backscroll_num > 0) &&
+                 ((!big) ||
+                  ((ty->backmem.comp + ty->backmem.uncomp) >
+                   (big->backmem.comp + big->backmem.uncomp))))
+               big = ty;
+          }
+        if (!big) return;
+        // lines still to be reflowed are older than all of back[]
+        if (big->reflow.num) termpty_reflow_drop(big);
+        for (i = 0; i < 64; i++)
+          {
+             if ((big->backscroll_num <= 0) || (mem_rows <= mem_budget))
+               break;
+             termpty_save_drop(big, (big->backpos - big->backscroll_num +
+                                     big->backmax) % big->backmax);
+             big->backscroll_num--;
+          }
+        if (big->obj) termio_backscroll_drop(big->obj);
+        if (ecore_time_get() > t_end)
           {
-             ty->back[i] = _save_comp(ty->back[i]);
-             tsc = (Termsavecomp *)ty->back[i];
-             if (tsc->comp) ts_comp++;
-             else ts_uncomp++;
-//             c0 += tsc->w;
-//             c1 += tsc->wout * sizeof(Termcell);
+             comp_more = EINA_TRUE;
+             return;
           }
      }
-//   printf("compress ratio: %1.3f\n", (double)c0 / (double)c1);
 }
 
 static Eina_Bool
 _idler(void *data EINA_UNUSED)
 {
+   Comp_Batch *b;
    Eina_List *l;
    Termpty *ty;
-//   double t0, t;
+   double t_end = ecore_time_get() + comp_budget;
    
-   _mem_gen_next();
+   idler = NULL;
+   // the batch in flight will come back here when done
+   if ((comp_thread) || (comp_done)) return EINA_FALSE;
+   b = calloc(1, sizeof(Comp_Batch));
+   if (!b) return EINA_FALSE;
 
-//   t0 = ecore_time_get();
-   // start afresh and count comp/uncomp;
-   ts_comp = 0;
-   ts_uncomp = 0;
+   comp_more = EINA_FALSE;
+   _mem_budget_keep(t_end);
    EINA_LIST_FOREACH(ptys, l, ty)
      {
-        _walk_pty(ty);
+        if ((ty->reflow.num) && (termpty_reflow_step(ty, t_end)))
+          comp_more = EINA_TRUE;
+        _walk_pty(ty, b, t_end);
      }
-//   t = ecore_time_get();
-//   printf("comp/uncomp %i/%i time spent %1.5f\n", ts_comp, ts_uncomp, t - t0);
-   _mem_defrag();
-   ts_freeops = 0;
-   
-   _mem_gen_next();
-   
-   idler = NULL;
+   if (!b->num)
+     {
+        free(b);
+        // nothing left to compress, a good time to give memory back
+        _mem_compact();
+        ts_freeops = 0;
+        _check_compressor(EINA_FALSE);
+        return EINA_FALSE;
+     }
+   // LZ4 runs in a thread, only the swap of the row pointers is left for
+   // the main loop in _comp_apply()
+   _mem_pin();
+   comp_thread = ecore_thread_run(_comp_thread_run, _comp_thread_end,
+                                  _comp_thread_cancel, b);
    return EINA_FALSE;
 }
 
@@ -301,7 +946,19 @@ static inline void
 _check_compressor(Eina_Bool frozen)
 {
    if (freeze) return;
-   if (idler) return;
+   if ((idler) || (comp_thread) || (comp_done)) return;
+   // out of budget last time - carry on once the loop is idle again
+   if (comp_more)
+     {
+        idler = ecore_idler_add(_idler, NULL);
+        return;
+     }
+   // no waiting for the output to calm down once over the memory budget
+   if ((mem_budget) && (mem_rows > mem_budget))
+     {
+        idler = ecore_idler_add(_idler, NULL);
+        return;
+     }
    if ((ts_uncomp > 256) || (ts_freeops > 256))
      {
         if (timer && !frozen) ecore_timer_reset(timer);
@@ -312,8 +969,8 @@ _check_compressor(Eina_Bool frozen)
 void
 termpty_save_freeze(void)
 {
-   // XXX: suspend compressor - this probably should be in a thread but right
-   // now it'll be fine here 
+   // suspend starting a compressor batch. one already in its thread keeps
+   // going but its results wait for the thaw
    if (!freeze++)
      {
         if (timer) ecore_timer_freeze(timer);
@@ -328,10 +985,17 @@ termpty_save_freeze(void)
 void
 termpty_save_thaw(void)
 {
-   // XXX: resume compressor
+   // resume compressor
    freeze--;
    if (freeze <= 0)
      {
+        if (comp_done)
+          {
+             Comp_Batch *b = comp_done;
+
+             comp_done = NULL;
+             _comp_apply(b);
+          }
         if (timer) ecore_timer_thaw(timer);
         _check_compressor(EINA_TRUE);
      }
@@ -350,13 +1014,154 @@ termpty_save_unregister(Termpty *ty)
 {
    termpty_save_freeze();
    ptys = eina_list_remove(ptys, ty);
+   mem_rows -= ty->backmem.comp + ty->backmem.uncomp;
+   ty->backmem.comp = ty->backmem.uncomp = 0;
+   free(ty->backdirty.slot);
+   ty->backdirty.slot = NULL;
+   ty->backdirty.num = ty->backdirty.size = ty->backdirty.fresh = 0;
+   termpty_save_spill_set(ty, EINA_FALSE);
    termpty_save_thaw();
 }
 
+void
+termpty_save_dirty(Termpty *ty, int slot)
+{
+   // rows are saved at backpos, so the ones not looked at yet are a range
+   // just before it and one more is only a count
+   _row_account(ty, ty->back[slot], EINA_TRUE);
+   if (ty->backdirty.fresh < ty->backmax) ty->backdirty.fresh++;
+}
+
+void
+termpty_save_queue(Termpty *ty, int slot)
+{
+   Termsave *ts = ty->back[slot];
+
+   // a row put in back[] elsewhere than at backpos, as the reflow does
+   _row_account(ty, ts, EINA_TRUE);
+   if ((ts) && (!ts->comp) && (!_dirty_add(ty, slot)))
+     ERR("Cannot track scrollback row %i for compression", slot);
+}
+
+void
+termpty_save_more(void)
+{
+   // work left for the idler that isn't in back[] yet
+   comp_more = EINA_TRUE;
+   _check_compressor(EINA_FALSE);
+}
+
+void
+termpty_save_rescan(Termpty *ty)
+{
+   int i;
+
+   ty->backdirty.num = 0;
+   ty->backdirty.fresh = 0;
+   ty->backdirty.rescan = EINA_FALSE;
+   // the byte count is redone along with the list
+   mem_rows -= ty->backmem.comp + ty->backmem.uncomp;
+   ty->backmem.comp = ty->backmem.uncomp = 0;
+   if (!ty->back) return;
+   for (i = 0; i < ty->backmax; i++)
+     {
+        _row_account(ty, ty->back[i], EINA_TRUE);
+        if ((ty->back[i]) && (!ty->back[i]->comp))
+          {
+             if (!_dirty_add(ty, i))
+               {
+                  ERR("Cannot track scrollback rows for compression");
+                  return;
+               }
+          }
+     }
+}
+
+void
+termpty_save_chunks_set(Eina_Bool chunks)
+{
+   comp_chunks = chunks;
+}
+
+void
+termpty_save_drop(Termpty *ty, int slot)
+{
+   Termsave *ts = ty->back[slot];
+
+   if (!ts) return;
+   _row_account(ty, ts, EINA_FALSE);
+   ty->back[slot] = NULL;
+   if (ty->spill)
+     {
+        Termsave *ts2 = termpty_save_extract(ts);
+
+        // a row that cannot be decompressed is only dropped
+        if (ts2)
+          {
+             termpty_save_spill(ty, ts2);
+             ts = ts2;
+          }
+     }
+   termpty_save_free(ts);
+}
+
+void
+termpty_save_mem_get(const Termpty *ty, size_t *comp, size_t *uncomp)
+{
+   if (comp) *comp = ty->backmem.comp;
+   if (uncomp) *uncomp = ty->backmem.uncomp;
+}
+
+size_t
+termpty_save_mem_total_get(void)
+{
+   return mem_rows;
+}
+
+void
+termpty_save_mem_budget_set(int mb)
+{
+   if (mb < 0) mb = 0;
+   mem_budget = (size_t)mb * 1024 * 1024;
+   _check_compressor(EINA_FALSE);
+}
+
+void
+termpty_save_budget_set(int ms)
+{
+   if (ms < 1) ms = 1;
+   comp_budget = (double)ms / 1000.0;
+}
+
 Termsave *
 termpty_save_extract(Termsave *ts)
 {
    if (!ts) return NULL;
+   if (ts->ref)
+     {
+        Termsaveref *tsr = (Termsaveref *)ts;
+        Termsavechunk *ch = tsr->chunk;
+        const Termcell *cells;
+        Termsave *ts2;
+        int w;
+
+        cells = _chunk_cells(ch);
+        if (!cells) return NULL;
+        w = ch->off[tsr->row + 1] - ch->off[tsr->row];
+        ts2 = _mem_new(sizeof(Termsave) + ((w - 1) * sizeof(Termcell)));
+        if (!ts2) return NULL;
+        ts2->w = w;
+        memcpy(&(ts2->cell[0]), cells + ch->off[tsr->row],
+               w * sizeof(Termcell));
+        ts_comp--;
+        ts_uncomp++;
+        ts_freeops++;
+        ts_compfreeze++;
+        termpty_save_free(ts);
+        ts_compfreeze--;
+        _check_compressor(EINA_FALSE);
+        return ts2;
+     }
    if (ts->z)
      {
         Termsavecomp *tsc = (Termsavecomp *)ts;
@@ -366,7 +1171,6 @@ termpty_save_extract(Termsave *ts)
         
         ts2 = _mem_new(sizeof(Termsave) + ((tsc->wout - 1) * sizeof(Termcell)));
         if (!ts2) return NULL;
-        ts2->gen = _mem_gen_get();
         ts2->w = tsc->wout;
         buf = ((char *)tsc) + sizeof(Termsavecomp);
         bytes = LZ4_uncompress(buf, (char *)(&(ts2->cell[0])),
@@ -381,6 +1185,7 @@ termpty_save_extract(Termsave *ts)
         ts_uncomp++;
         ts_freeops++;
         ts_compfreeze++;
+        _row_forget(ts);
         _mem_free(ts);
         ts_compfreeze--;
         _check_compressor(EINA_FALSE);
@@ -390,12 +1195,64 @@ termpty_save_extract(Termsave *ts)
    return ts;
 }
 
+/* the cells of a row as they are, without taking a compressed row out of
+ * its compressed copy. they stay valid until a few hundred more rows are
+ * looked at or the row goes */
+Termcell *
+termpty_save_cells_get(Termsave *ts, int *wret)
+{
+   Termcell *cells;
+
+   if (!ts) return NULL;
+   if (ts->ref)
+     {
+        Termsaveref *tsr = (Termsaveref *)ts;
+        Termsavechunk *ch = tsr->chunk;
+
+        cells = (Termcell *)_chunk_cells(ch);
+        if (!cells) return NULL;
+        *wret = ch->off[tsr->row + 1] - ch->off[tsr->row];
+        return cells + ch->off[tsr->row];
+     }
+   if (!ts->z)
+     {
+        *wret = ts->w;
+        return ts->cell;
+     }
+   cells = _row_cells(ts);
+   if (!cells) return NULL;
+   *wret = ((Termsavecomp *)ts)->wout;
+   return cells;
+}
+
+int
+termpty_save_width(const Termsave *ts)
+{
+   if (!ts) return 0;
+   if (ts->ref)
+     {
+        const Termsaveref *tsr = (const Termsaveref *)ts;
+
+        return tsr->chunk->off[tsr->row + 1] - tsr->chunk->off[tsr->row];
+     }
+   if (ts->z) return ((const Termsavecomp *)ts)->wout;
+   return ts->w;
+}
+
+/* whether the row goes on in the next one, looked up without decompressing */
+Eina_Bool
+termpty_save_wrapped(const Termsave *ts)
+{
+   if (!ts) return EINA_FALSE;
+   if (ts->z) return ts->wrap;
+   return (ts->w > 0) && (ts->cell[ts->w - 1].att.autowrapped);
+}
+
 Termsave *
 termpty_save_new(int w)
 {
    Termsave *ts = _mem_new(sizeof(Termsave) + ((w - 1) * sizeof(Termcell)));
    if (!ts) return NULL;
-   ts->gen = _mem_gen_get();
    ts->w = w;
    if (!ts_compfreeze) ts_uncomp++;
    _check_compressor(EINA_FALSE);
@@ -412,6 +1269,238 @@ termpty_save_free(Termsave *ts)
         else ts_uncomp--;
         ts_freeops++;
      }
+   if (ts->ref) _chunk_unref(((Termsaveref *)ts)->chunk);
+   _row_forget(ts);
    _mem_free(ts);
    _check_compressor(EINA_FALSE);
 }
+
+/* rows pushed out of back[] can go on to a temporary file of the terminal.
+ * they are compressed SPILL_ROWS at a time, each chunk being the row offsets
+ * followed by the LZ4 data, and mapped back in when looked at */
+#define SPILL_ROWS 256
+
+typedef struct _Spill_Chunk Spill_Chunk;
+typedef struct _Spill_Cache Spill_Cache;
+
+struct _Spill_Chunk
+{
+   off_t off;
+   int bytes;
+};
+
+struct _Spill_Cache
+{
+   int chunk; // -1 if unused
+   int off[SPILL_ROWS + 1];
+   Termcell *cells;
+   int size;
+};
+
+struct _Termspill
+{
+   int fd;
+   off_t size;
+   Spill_Chunk *chunks;
+   int chunks_num, chunks_size;
+   struct {
+      Termcell *cells; // rows not written out yet
+      int off[SPILL_ROWS + 1];
+      int rows, size;
+   } pend;
+   Spill_Cache cache[2]; // most recently used first
+   Eina_Bool failed : 1; // could not write, nothing more is kept
+};
+
+static Eina_Bool
+_spill_flush(Termspill *sp)
+{
+   Spill_Chunk *ch;
+   char *buf;
+   int bytes, size = sp->pend.off[SPILL_ROWS] * sizeof(Termcell);
+   int head = sizeof(sp->pend.off);
+   ssize_t done = 0;
+
+   if (sp->chunks_num >= sp->chunks_size)
+     {
+        int num = sp->chunks_size ? sp->chunks_size * 2 : 64;
+
+        ch = realloc(sp->chunks, num * sizeof(Spill_Chunk));
+        if (!ch) return EINA_FALSE;
+        sp->chunks = ch;
+        sp->chunks_size = num;
+     }
+   buf = malloc(head + LZ4_compressBound(size));
+   if (!buf) return EINA_FALSE;
+   memcpy(buf, sp->pend.off, head);
+   bytes = head + LZ4_compress((char *)sp->pend.cells, buf + head, size);
+   while (done < bytes)
+     {
+        ssize_t n = write(sp->fd, buf + done, bytes - done);
+
+        if (n <= 0)
+          {
+             if ((n < 0) && (errno == EINTR)) continue;
+             // lose what was written, later chunks go where this one was
+             if (ftruncate(sp->fd, sp->size) < 0) {}
+             lseek(sp->fd, sp->size, SEEK_SET);
+             free(buf);
+             return EINA_FALSE;
+          }
+        done += n;
+     }
+   free(buf);
+   ch = &(sp->chunks[sp->chunks_num++]);
+   ch->off = sp->size;
+   ch->bytes = bytes;
+   sp->size += bytes;
+   sp->pend.rows = 0;
+   return EINA_TRUE;
+}
+
+static Spill_Cache *
+_spill_chunk_get(Termspill *sp, int chunk)
+{
+   Spill_Chunk *ch = &(sp->chunks[chunk]);
+   Spill_Cache c;
+   unsigned char *map;
+   off_t pg;
+   size_t delta;
+   int cells;
+
+   if (sp->cache[0].chunk == chunk) return &(sp->cache[0]);
+   c = sp->cache[1];
+   sp->cache[1] = sp->cache[0];
+   if (c.chunk != chunk)
+     {
+        pg = ch->off & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+        delta = ch->off - pg;
+        map = mmap(NULL, delta + ch->bytes, PROT_READ, MAP_SHARED, sp->fd, pg);
+        if (map == MAP_FAILED) goto err;
+        memcpy(c.off, map + delta, sizeof(c.off));
+        cells = c.off[SPILL_ROWS];
+        if (c.size < cells)
+          {
+             Termcell *tmp = realloc(c.cells, cells * sizeof(Termcell));
+
+             if (!tmp)
+               {
+                  munmap(map, delta + ch->bytes);
+                  goto err;
+               }
+             c.cells = tmp;
+             c.size = cells;
+          }
+        if ((cells > 0) &&
+            (LZ4_uncompress((char *)map + delta + sizeof(c.off),
+                            (char *)c.cells, cells * sizeof(Termcell)) < 0))
+          memset(c.cells, 0, cells * sizeof(Termcell));
+        munmap(map, delta + ch->bytes);
+        c.chunk = chunk;
+     }
+   sp->cache[0] = c;
+   return &(sp->cache[0]);
+err:
+   c.chunk = -1;
+   sp->cache[0] = c;
+   ERR("Cannot read scrollback back from disk");
+   return NULL;
+}
+
+void
+termpty_save_spill_set(Termpty *ty, Eina_Bool on)
+{
+   Termspill *sp = ty->spill;
+   char buf[PATH_MAX];
+   const char *dir;
+   int i;
+
+   if (!!sp == !!on) return;
+   if (sp)
+     {
+        close(sp->fd);
+        free(sp->chunks);
+        free(sp->pend.cells);
+        for (i = 0; i < 2; i++) free(sp->cache[i].cells);
+        free(sp);
+        ty->spill = NULL;
+        return;
+     }
+   sp = calloc(1, sizeof(Termspill));
+   if (!sp) return;
+   dir = getenv("TMPDIR");
+   if (!dir) dir = "/tmp";
+   snprintf(buf, sizeof(buf), "%s/terminology-scrollback-XXXXXX", dir);
+   sp->fd = mkstemp(buf);
+   if (sp->fd < 0)
+     {
+        ERR("Cannot create scrollback file %s: %s", buf, strerror(errno));
+        free(sp);
+        return;
+     }
+   // nobody else needs to find it and it goes away with the terminal
+   unlink(buf);
+   if (fcntl(sp->fd, F_SETFD, FD_CLOEXEC) < 0) ERR("fcntl: %s", strerror(errno));
+   sp->cache[0].chunk = sp->cache[1].chunk = -1;
+   ty->spill = sp;
+}
+
+void
+termpty_save_spill(Termpty *ty, Termsave *ts)
+{
+   Termspill *sp = ty->spill;
+   int cells;
+
+   // once a row could not be kept later ones are dropped as if there was no
+   // disk, what is written or still pending stays readable
+   if ((!sp) || (!ts) || (sp->failed)) return;
+   cells = sp->pend.off[sp->pend.rows] + ts->w;
+   if (cells > sp->pend.size)
+     {
+        int size = (cells > sp->pend.size * 2) ? cells : sp->pend.size * 2;
+        Termcell *tmp = realloc(sp->pend.cells, size * sizeof(Termcell));
+
+        if (!tmp) goto err;
+        sp->pend.cells = tmp;
+        sp->pend.size = size;
+     }
+   memcpy(sp->pend.cells + sp->pend.off[sp->pend.rows], ts->cell,
+          ts->w * sizeof(Termcell));
+   sp->pend.rows++;
+   sp->pend.off[sp->pend.rows] = cells;
+   if ((sp->pend.rows == SPILL_ROWS) && (!_spill_flush(sp))) goto err;
+   return;
+err:
+   ERR("Cannot write scrollback out to disk, no more lines are kept there");
+   sp->failed = EINA_TRUE;
+}
+
+int
+termpty_save_spill_rows(const Termpty *ty)
+{
+   if (!ty->spill) return 0;
+   return (ty->spill->chunks_num * SPILL_ROWS) + ty->spill->pend.rows;
+}
+
+Termcell *
+termpty_save_spill_get(Termpty *ty, int y, int *wret)
+{
+   Termspill *sp = ty->spill;
+   Spill_Cache *c;
+   int row;
+
+   // y counts back from the most recent row
+   if ((!sp) || (y < 0) || (y >= termpty_save_spill_rows(ty))) return NULL;
+   row = termpty_save_spill_rows(ty) - 1 - y;
+   if (row >= (sp->chunks_num * SPILL_ROWS))
+     {
+        row -= sp->chunks_num * SPILL_ROWS;
+        *wret = sp->pend.off[row + 1] - sp->pend.off[row];
+        return sp->pend.cells + sp->pend.off[row];
+     }
+   c = _spill_chunk_get(sp, row / SPILL_ROWS);
+   if (!c) return NULL;
+   row %= SPILL_ROWS;
+   *wret = c->off[row + 1] - c->off[row];
+   return c->cells + c->off[row];
+}
@@ -5,7 +5,24 @@ void termpty_save_freeze(void);
 void termpty_save_thaw(void);
 void termpty_save_register(Termpty *ty);
 void termpty_save_unregister(Termpty *ty);
+void termpty_save_dirty(Termpty *ty, int slot);
+void termpty_save_queue(Termpty *ty, int slot);
+void termpty_save_more(void);
+void termpty_save_rescan(Termpty *ty);
+void termpty_save_drop(Termpty *ty, int slot);
+void termpty_save_mem_get(const Termpty *ty, size_t *comp, size_t *uncomp);
+size_t termpty_save_mem_total_get(void);
+void termpty_save_mem_budget_set(int mb);
+void termpty_save_budget_set(int ms);
+void termpty_save_chunks_set(Eina_Bool chunks);
+void termpty_save_spill_set(Termpty *ty, Eina_Bool on);
+void termpty_save_spill(Termpty *ty, Termsave *ts);
+int termpty_save_spill_rows(const Termpty *ty);
+Termcell *termpty_save_spill_get(Termpty *ty, int y, int *wret);
 Termsave *termpty_save_extract(Termsave *ts);
+Termcell *termpty_save_cells_get(Termsave *ts, int *wret);
+int termpty_save_width(const Termsave *ts);
+Eina_Bool termpty_save_wrapped(const Termsave *ts);
 Termsave *termpty_save_new(int w);
 void termpty_save_free(Termsave *ts);
 
@@ -1,4 +1,11 @@
 #include "utf8.h"
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#include <stdint.h>
+#include <string.h>
+
+#define UTF8_REPLACEMENT 0xfffd
 
 int
 codepoint_to_utf8(Eina_Unicode g, char *txt)
@@ -60,3 +67,145 @@ codepoint_to_utf8(Eina_Unicode g, char *txt)
         return 0;
      }
 }
+
+void
+utf8_decoder_reset(Utf8_Decoder *dec)
+{
+   memset(dec, 0, sizeof(*dec));
+}
+
+#define ONES  ((uint64_t)0x0101010101010101ULL)
+#define HIGHS ((uint64_t)0x8080808080808080ULL)
+
+/* length of the leading run of printable ascii (0x20 - 0x7e) in buf. these
+ * bytes map 1:1 to codepoints and never take part in an escape sequence, so
+ * the terminal can put them on screen without decoding them */
+int
+utf8_ascii_printable_len(const char *buf, int len)
+{
+   const unsigned char *p = (const unsigned char *)buf;
+   int i = 0;
+
+#if defined(__SSE2__)
+   const __m128i lo = _mm_set1_epi8(0x1f);
+   const __m128i hi = _mm_set1_epi8(0x7f);
+
+   // bytes >= 0x80 are negative as signed chars, so they fail "> 0x1f"
+   for (; i + 16 <= len; i += 16)
+     {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo),
+                                   _mm_cmplt_epi8(v, hi));
+        unsigned int mask = _mm_movemask_epi8(ok);
+
+        if (mask != 0xffff)
+          return i + __builtin_ctz(~mask);
+     }
+#else
+   for (; i + 8 <= len; i += 8)
+     {
+        uint64_t v;
+
+        memcpy(&v, p + i, sizeof(v));
+        // any byte with high bit set, below 0x20 or equal to 0x7f
+        if ((v & HIGHS) ||
+            ((v - (ONES * 0x20)) & ~v & HIGHS) ||
+            (((v ^ (ONES * 0x7f)) - ONES) & ~(v ^ (ONES * 0x7f)) & HIGHS))
+          break;
+     }
+#endif
+   for (; i < len; i++)
+     {
+        if ((p[i] < 0x20) || (p[i] >= 0x7f)) break;
+     }
+   return i;
+}
+
+/* decode len bytes of buf into out, which must have room for len + 1
+ * codepoints (a sequence left incomplete by a previous call can turn into a
+ * replacement char in front of the first byte). returns the number of
+ * codepoints written. incomplete trailing sequences stay in dec. invalid,
+ * overlong and surrogate sequences decode to U+FFFD */
+int
+utf8_decode(Utf8_Decoder *dec, const char *buf, int len, Eina_Unicode *out)
+{
+   const unsigned char *p = (const unsigned char *)buf;
+   const unsigned char *pe = p + len;
+   Eina_Unicode *o = out;
+
+   while (p < pe)
+     {
+        unsigned char c = *p;
+
+        if (dec->left)
+          {
+             if ((c & 0xc0) == 0x80)
+               {
+                  dec->codepoint = (dec->codepoint << 6) | (c & 0x3f);
+                  p++;
+                  if (--dec->left) continue;
+                  if ((dec->codepoint < dec->min) ||
+                      (dec->codepoint > 0x10ffff) ||
+                      ((dec->codepoint >= 0xd800) &&
+                       (dec->codepoint <= 0xdfff)))
+                    *o++ = UTF8_REPLACEMENT;
+                  else
+                    *o++ = dec->codepoint;
+                  continue;
+               }
+             // sequence cut short - flag it and look at c again
+             dec->left = 0;
+             *o++ = UTF8_REPLACEMENT;
+          }
+        if (c < 0x80)
+          {
+             // plain ascii - widen as much as possible at once
+#if defined(__SSE2__)
+             while ((pe - p) >= 16)
+               {
+                  const __m128i zero = _mm_setzero_si128();
+                  __m128i v = _mm_loadu_si128((const __m128i *)p);
+                  __m128i v16;
+
+                  if (_mm_movemask_epi8(v)) break;
+                  v16 = _mm_unpacklo_epi8(v, zero);
+                  _mm_storeu_si128((__m128i *)(o + 0),
+                                   _mm_unpacklo_epi16(v16, zero));
+                  _mm_storeu_si128((__m128i *)(o + 4),
+                                   _mm_unpackhi_epi16(v16, zero));
+                  v16 = _mm_unpackhi_epi8(v, zero);
+                  _mm_storeu_si128((__m128i *)(o + 8),
+                                   _mm_unpacklo_epi16(v16, zero));
+                  _mm_storeu_si128((__m128i *)(o + 12),
+                                   _mm_unpackhi_epi16(v16, zero));
+                  o += 16;
+                  p += 16;
+               }
+#endif
+             while ((p < pe) && (*p < 0x80)) *o++ = *p++;
+             continue;
+          }
+        p++;
+        if ((c & 0xe0) == 0xc0)
+          {
+             dec->codepoint = c & 0x1f;
+             dec->min = 0x80;
+             dec->left = 1;
+          }
+        else if ((c & 0xf0) == 0xe0)
+          {
+             dec->codepoint = c & 0x0f;
+             dec->min = 0x800;
+             dec->left = 2;
+          }
+        else if ((c & 0xf8) == 0xf0)
+          {
+             dec->codepoint = c & 0x07;
+             dec->min = 0x10000;
+             dec->left = 3;
+          }
+        else // stray continuation or invalid lead byte
+          *o++ = UTF8_REPLACEMENT;
+     }
+   return o - out;
+}
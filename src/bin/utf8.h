@@ -1,6 +1,22 @@
 #ifndef _UTF8_H__
 #define _UTF8_H__ 1
 #include <Eina.h>
+
+typedef struct _Utf8_Decoder Utf8_Decoder;
+
+/* streaming decoder state - a sequence cut by the end of one buffer is
+ * resumed with the first bytes of the next one */
+struct _Utf8_Decoder
+{
+   Eina_Unicode  codepoint; // bits collected so far
+   Eina_Unicode  min; // smallest codepoint allowed for this length
+   unsigned char left; // continuation bytes still expected
+};
+
 int codepoint_to_utf8(Eina_Unicode g, char *txt);
 
+void utf8_decoder_reset(Utf8_Decoder *dec);
+int  utf8_ascii_printable_len(const char *buf, int len);
+int  utf8_decode(Utf8_Decoder *dec, const char *buf, int len, Eina_Unicode *out);
+
 #endif